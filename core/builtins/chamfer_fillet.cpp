@@ -95,6 +95,15 @@ Value builtin_chamfer_filler(CallContext &c) {
         [&](const Argument &arg) { parseEdgeSpec(arg, result, filters, r); }
     );
 
+    // Rounding edges stays within the bounding box, and previews show the edges sharp
+    if (c.fidelity() != Fidelity::Full) {
+        c.execContext().setSimplified();
+        for (const auto &ch : children) {
+            result.push_back(c.fidelity() == Fidelity::Preview ? ch.withProp("preview", true) : ch);
+        }
+        return result;
+    }
+
     for (const auto &ch : children) {
         Algorithm algo(ch.shape());
         auto shapeBoundingBox = getBoundingBox(ch.shape());
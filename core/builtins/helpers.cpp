@@ -1,6 +1,7 @@
 #include <format>
 
 #include <BRepBndLib.hxx>
+#include <BRepPrimAPI_MakeBox.hxx>
 #include <gp_Ax1.hxx>
 #include <gp_Quaternion.hxx>
 #include <Precision.hxx>
@@ -47,6 +48,22 @@ Bnd_Box getBoundingBox(const TopoDS_Shape& shape) {
     return bbox;
 }
 
+TopoDS_Shape makeProxy(const Bnd_Box &box) {
+    if (box.IsVoid()) {
+        return {};
+    }
+
+    const auto min = box.CornerMin();
+    auto max = box.CornerMax();
+
+    // Flat shapes still get a box that can be built and seen
+    for (int i = 1; i <= 3; i++) {
+        max.SetCoord(i, std::max(max.Coord(i), min.Coord(i) + 2.0 * Precision::Confusion()));
+    }
+
+    return BRepPrimAPI_MakeBox{min, max}.Shape();
+}
+
 gp_XYZ parseVec(const Argument &arg, gp_XYZ default_, int elements) {
     if (!arg) {
         return default_;
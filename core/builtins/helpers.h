@@ -20,6 +20,8 @@ struct ShapeLocation {
 
 Bnd_Box getBoundingBox(const ShapeList& shapes);
 Bnd_Box getBoundingBox(const TopoDS_Shape& shape);
+// Stand-in for the result of an expensive operation in proxy runs: a box filling the bounding box, or a null shape
+TopoDS_Shape makeProxy(const Bnd_Box &box);
 gp_XYZ parseXYZ(const CallContext &c, const Argument &arg, double default_);
 gp_XY parseXY(const CallContext &c, const Argument &arg, double default_);
 gp_XYZ parseVec(const Argument &arg, gp_XYZ default_={}, int elements=3);
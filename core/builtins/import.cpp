@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <filesystem>
+#include <format>
+
+#include "helpers.h"
+#include "importcache.h"
+#include "mappedfile.h"
+#include "memorystream.h"
+#include "shapeio.h"
+#include "stepreader.h"
+#include "stl.h"
+
+namespace
+{
+
+std::string fileExtension(const std::string &path) {
+    auto ext = std::filesystem::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char ch) { return std::tolower(ch); });
+    return ext;
+}
+
+Value importStl(const CallContext &c, const std::string &path) {
+    MappedFile file{path};
+    if (!file.isOpen()) {
+        return c.error("cannot open {}: {}", path, file.error());
+    }
+
+    auto stl = readStl(file.data());
+    if (!stl.shape) {
+        return c.error("cannot import {}: {}", path, stl.error);
+    }
+
+    return ShapeList{Shape{*stl.shape, c.span()}};
+}
+
+ShapeList withSpan(const ShapeList &shapes, const Span &span) {
+    ShapeList result;
+    result.reserve(shapes.size());
+    for (const auto &sh : shapes) {
+        result.push_back(Shape{sh.shape(), sh.props(), {span}});
+    }
+
+    return result;
+}
+
+Value importStep(const CallContext &c, const std::string &path) {
+    uint64_t hash;
+    {
+        MappedFile file{path};
+        if (!file.isOpen()) {
+            return c.error("cannot open {}: {}", path, file.error());
+        }
+
+        hash = contentHash(file.data());
+    }
+
+    if (auto cached = loadImportCache(hash)) {
+        return withSpan(*cached, c.span());
+    }
+
+    // Reading STEP is what proxy runs are meant to skip
+    if (c.fidelity() == Fidelity::Proxy) {
+        c.execContext().setSimplified();
+        return ShapeList{};
+    }
+
+    auto step = readStep(path);
+    if (!step.shapes) {
+        return c.error("cannot import {}: {}", path, step.error);
+    }
+
+    storeImportCache(hash, *step.shapes);
+
+    return withSpan(*step.shapes, c.span());
+}
+
+Value importPcBrep(const CallContext &c, const std::string &path) {
+    MappedFile file{path};
+    if (!file.isOpen()) {
+        return c.error("cannot open {}: {}", path, file.error());
+    }
+
+    MemoryStream s(file.data());
+    auto shapes = readShapes(s);
+    if (!shapes) {
+        return c.error("cannot import {}: not a valid pollocad BRep file", path);
+    }
+
+    // Spans in the file refer to the script that produced it, so they are replaced with the import call
+    return withSpan(*shapes, c.span());
+}
+
+Value builtin_import(CallContext &c) {
+    const auto path = c.arg("file name").as<std::string>();
+    if (path.empty()) {
+        return undefined;
+    }
+
+    const auto ext = fileExtension(path);
+    if (ext == ".stl") {
+        return importStl(c, path);
+    } else if (ext == ".step" || ext == ".stp") {
+        return importStep(c, path);
+    } else if (ext == ".pcbrep") {
+        return importPcBrep(c, path);
+    }
+
+    return c.error("unsupported file type: {}", path);
+}
+
+}
+
+void add_builtins_import(Environment &env) {
+    env.setFunction("import", builtin_import);
+}
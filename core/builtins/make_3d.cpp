@@ -1,25 +1,22 @@
 #include <format>
 
 #include "helpers.h"
+#include "meshcache.h"
+#include "memorystream.h"
 
-#include <BRepBuilderAPI_MakeVertex.hxx>
-#include <BRepBuilderAPI_MakeEdge.hxx>
-#include <BRepBuilderAPI_MakeWire.hxx>
-#include <BRepBuilderAPI_MakeFace.hxx>
-#include <BRepBuilderAPI_MakeSolid.hxx>
-#include <BRepBuilderAPI_Sewing.hxx>
+#include <BinTools.hxx>
 #include <BRepPrimAPI_MakeBox.hxx>
 #include <BRepPrimAPI_MakeCone.hxx>
 #include <BRepPrimAPI_MakeCylinder.hxx>
 #include <BRepPrimAPI_MakeSphere.hxx>
-#include <RWStl.hxx>
 #include <TopoDS.hxx>
 
 namespace
 {
 
-const uint8_t polloStl[] = {
-#include "generated/pollo.hex"
+// Pre-built at compile time from the STL by PolloBrep
+const uint8_t polloBrep[] = {
+#include "generated/pollo_brep.hex"
 };
 
 Value addShapeChildren(const CallContext &c, ShapeList shape) {
@@ -108,71 +105,15 @@ Value builtin_sphere(const CallContext &c) {
     return addShapeChildren(c, ShapeList{Shape{shape, c.span()}});
 }
 
-TopoDS_Shape loadStlData(std::istream &s) {
-    // No error checks here - data better be valid!
-
-    s.ignore(80); // header
-
-    uint32_t numTris = 0;
-    s.read(reinterpret_cast<char *>(&numTris), sizeof(numTris)); // number of triangles
-
-    struct VecF {
-        float x, y, z;
-    };
-
-    TopoDS_Compound comp;
-    TopoDS_Builder builder;
-    builder.MakeCompound(comp);
-
-    std::vector<TopoDS_Vertex> verts;
-
-    for (uint32_t i = 0; i < numTris; i++) {
-        s.ignore(sizeof(VecF)); // ignore normal
-
-        size_t vertIndex[3];
-        for (size_t j = 0; j < 3; j++) {
-            float coords[3];
-            s.read(reinterpret_cast<char *>(coords), sizeof(coords)); // vertices
-
-            gp_Pnt pt{coords[0], coords[1], coords[2]};
-
-            size_t index = 0;
-            for (const auto &v : verts) {
-                if (BRep_Tool::Pnt(v).IsEqual(pt, Precision::Approximation())) {
-                    break;
-                }
-
-                index++;
-            }
-
-            if (index == verts.size()) {
-                verts.push_back(BRepBuilderAPI_MakeVertex{pt});
-            }
-
-            vertIndex[j] = index;
-        }
-
-        builder.Add(comp, BRepBuilderAPI_MakeFace{
-            BRepBuilderAPI_MakeWire{
-                BRepBuilderAPI_MakeEdge{verts[vertIndex[0]], verts[vertIndex[1]]},
-                BRepBuilderAPI_MakeEdge{verts[vertIndex[1]], verts[vertIndex[2]]},
-                BRepBuilderAPI_MakeEdge{verts[vertIndex[2]], verts[vertIndex[0]]}
-            }
-        });
-
-        s.ignore(sizeof(uint16_t)); // ignore "attribute byte count"
-    }
-
-    BRepBuilderAPI_Sewing sewing;
-    sewing.Load(comp);
-    sewing.Perform();
+TopoDS_Shape loadPollo() {
+    MemoryStream s(std::string_view(reinterpret_cast<const char *>(polloBrep), sizeof(polloBrep)));
 
-    return BRepBuilderAPI_MakeSolid{TopoDS::Shell(sewing.SewedShape())}.Shape();
-}
+    TopoDS_Shape shape;
+    BinTools::Read(shape, s);
 
-TopoDS_Shape loadPollo() {
-    std::istringstream s(std::string(reinterpret_cast<const char *>(polloStl), sizeof(polloStl)));
-    return loadStlData(s);
+    // Every run that calls pollo() returns this one shape
+    registerSharedShape(shape);
+    return shape;
 }
 
 Value builtin_pollo(const CallContext &c) {
@@ -158,6 +158,37 @@ Value builtin_combine(const CallContext &c) {
 
     std::vector<Span> spans;
 
+    if (c.fidelity() == Fidelity::Proxy) {
+        c.execContext().setSimplified();
+
+        // What is removed can only shrink the result
+        Bnd_Box box;
+        for (auto it = children.begin(); it != remove; it++) {
+            std::copy(it->spans().begin(), it->spans().end(), std::back_inserter(spans));
+            box.Add(getBoundingBox(it->shape()));
+        }
+
+        result.push_back(Shape{makeProxy(box), spans});
+        return result;
+    }
+
+    // Operands are overlaid instead of fused, with what would be cut away shown as a highlight
+    if (c.fidelity() == Fidelity::Preview) {
+        c.execContext().setSimplified();
+
+        for (auto it = children.begin(); it != remove; it++) {
+            result.push_back(it->withProp("preview", true));
+        }
+
+        for (auto it = remove; it != children.end(); it++) {
+            if (!it->hasProp("highlight")) {
+                result.push_back(it->withProp("highlight", true).withProp("preview", true));
+            }
+        }
+
+        return result;
+    }
+
     auto it = children.cbegin();
     TopoDS_Shape shape = it->shape();
     std::copy(it->spans().begin(), it->spans().end(), std::back_inserter(spans));
@@ -293,6 +324,11 @@ Value builtin_thru_sections(const CallContext &c) {
         return undefined;
     }
 
+    if (c.fidelity() == Fidelity::Proxy) {
+        c.execContext().setSimplified();
+        return ShapeList{Shape{makeProxy(getBoundingBox(children)), c.span()}};
+    }
+
     auto algo = BRepOffsetAPI_ThruSections{true, true};
 
     for (const auto &ch : children) {
@@ -1,5 +1,27 @@
 #include "contexts.h"
 
+std::vector<LogMessage> ExecutionContext::messages() {
+    std::unique_lock lock(m_messagesLock);
+
+    std::vector<LogMessage> messages;
+    messages.reserve(m_messages.size() + 1);
+
+    for (const auto &msg : m_messages) {
+        auto text = msg.format();
+        if (msg.count > 1) {
+            text += std::format(" ({} times)", msg.count);
+        }
+
+        messages.push_back(LogMessage{msg.level, std::move(text), msg.span});
+    }
+
+    if (m_droppedMessages > 0) {
+        messages.push_back(LogMessage{LogMessage::Level::Warning, std::format("{} more messages not shown", m_droppedMessages)});
+    }
+
+    return messages;
+}
+
 Argument CallContext::arg(const char *name) {
     const auto &value = (m_nextPositional < m_positional.size()) ? m_positional.at(m_nextPositional) : undefined;
     m_nextPositional++;
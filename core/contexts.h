@@ -2,15 +2,24 @@
 
 #include <atomic>
 #include <format>
+#include <functional>
+#include <map>
 #include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
+#include "executor.h"
 #include "value.h"
 #include "logmessage.h"
 
 class Argument;
 class ArgumentList;
 
+namespace ast { struct BlockExpr; }
+
 namespace
 {
 
@@ -28,26 +37,114 @@ using OverloadArgType =
     std::conditional_t<std::is_invocable_v<F, ArgumentList>, ArgumentList,
     std::conditional_t<std::is_invocable_v<F, bool>, bool, void>>>>>>>>>;
 
+// How message arguments are kept until the message is formatted. Strings are copied, because a const char * or
+// string_view argument usually points into something that is gone by then, such as an exception.
+template <typename T>
+using StoredMessageArg = std::conditional_t<std::is_convertible_v<const std::decay_t<T> &, std::string_view>,
+                                            std::string, std::decay_t<T>>;
+
+// Hashes a message argument without storing it. Strings hash the same whichever way they are passed.
+template <typename T>
+size_t messageArgHash(const T &arg) {
+    if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+        return std::hash<std::string_view>{}(arg);
+    } else if constexpr (requires { std::hash<T>{}(arg); }) {
+        return std::hash<T>{}(arg);
+    } else {
+        return std::hash<std::string>{}(std::format("{}", arg));
+    }
+}
+
 }
 
 class ExecutionContext {
 public:
-    ExecutionContext(const std::shared_ptr<std::atomic_bool> canceled) : m_canceled(canceled) { }
+    ExecutionContext(const std::shared_ptr<std::atomic_bool> canceled, Fidelity fidelity = Fidelity::Full)
+        : m_canceled(canceled), m_fidelity(fidelity) { }
 
+    // Warnings and errors with the same span, format string and arguments are merged into one message with a count, so
+    // a warning inside a loop costs a lookup per iteration. Info messages are output and are kept individually. Only the
+    // first c_maxMessages messages of a run are kept (see logmessage.h). Formatting is deferred until messages() is
+    // called.
     template <typename... Args>
     void addMessage(LogMessage::Level level, Span span, std::format_string<Args...> fmt, Args&&... args) {
-        const auto msg = std::format(fmt, std::forward<Args>(args)...);
+        size_t argsHash = 0;
+        ((argsHash ^= messageArgHash(args) + 0x9e3779b97f4a7c15ull + (argsHash << 6) + (argsHash >> 2)), ...);
+
+        const MessageKey key{span.begin, span.end, level, fmt.get().data(), argsHash};
+        const bool merge = level != LogMessage::Level::Info;
+
         std::unique_lock lock(m_messagesLock);
-        m_messages.push_back({level, msg, span});
+
+        if (merge) {
+            if (const auto it = m_messageIndex.find(key); it != m_messageIndex.end()) {
+                m_messages[it->second].count++;
+                return;
+            }
+        }
+
+        if (m_messages.size() >= c_maxMessages) {
+            m_droppedMessages++;
+            return;
+        }
+
+        if (merge) {
+            m_messageIndex.emplace(key, m_messages.size());
+        }
+
+        m_messages.push_back(PendingMessage{level, span, [fmt, ...args = StoredMessageArg<Args>(std::forward<Args>(args))] {
+            return std::vformat(fmt.get(), std::make_format_args(args...));
+        }});
     }
 
     bool isCanceled() { return m_canceled->load(); }
-    const std::vector<LogMessage> &messages() { return m_messages; }
+    Fidelity fidelity() const { return m_fidelity; }
+    // Called by builtins that left out work because of the fidelity
+    void setSimplified() { m_simplified = true; }
+    bool isSimplified() const { return m_simplified; }
+    std::vector<LogMessage> messages();
+
+    void setRoot(const ast::BlockExpr *root, const ExecutorCallbacks &callbacks) {
+        m_root = root;
+        m_callbacks = callbacks;
+    }
+
+    // Called by blocks after each of their statements. Only the root block reports progress and partial results.
+    void statementFinished(const ast::BlockExpr *block, size_t finished, size_t total, const ShapeList &shapes, bool addedShapes) const {
+        if (block != m_root) {
+            return;
+        }
+
+        if (m_callbacks.onProgress) {
+            m_callbacks.onProgress(finished, total);
+        }
+
+        if (addedShapes && finished < total && m_callbacks.onPartialResult) {
+            m_callbacks.onPartialResult(shapes);
+        }
+    }
 
 private:
+    struct PendingMessage {
+        LogMessage::Level level;
+        Span span;
+        std::function<std::string()> format;
+        int count = 1;
+    };
+
+    // The format string is identified by its address, which is unique per call site. Different arguments from the same
+    // call site, such as the names of two invalid arguments of one call, are told apart by the hash of the arguments.
+    using MessageKey = std::tuple<int, int, LogMessage::Level, const char *, size_t>;
+
     std::shared_ptr<std::atomic_bool> m_canceled;
+    const Fidelity m_fidelity;
+    std::atomic_bool m_simplified = false;
     std::mutex m_messagesLock;
-    std::vector<LogMessage> m_messages;
+    std::vector<PendingMessage> m_messages;
+    std::map<MessageKey, size_t> m_messageIndex;
+    size_t m_droppedMessages = 0;
+    const ast::BlockExpr *m_root = nullptr;
+    ExecutorCallbacks m_callbacks;
 };
 
 class Argument;
@@ -60,6 +157,7 @@ public:
     ExecutionContext &execContext() const { return m_execContext; }
 
     bool canceled() const { return m_execContext.isCanceled(); }
+    Fidelity fidelity() const { return m_execContext.fidelity(); }
 
     Argument arg(const char *name);
     Argument named(const char *name) const;
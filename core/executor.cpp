@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <format>
 #include <memory>
+#include <thread>
 #include <variant>
 
 #include "executor.h"
@@ -18,6 +20,41 @@ namespace
 
 Value eval(ExecutionContext &context, std::shared_ptr<Environment> env, const ast::Expr* expr, int recursionDepth);
 
+// Runs code in a new environment on top of the builtins. canceled is set once the run is done.
+ExecutorResult runCode(const std::shared_ptr<Environment> &builtins, const std::string &code,
+                       const std::shared_ptr<std::atomic_bool> &canceled, const ExecutorCallbacks &callbacks,
+                       Fidelity fidelity) {
+    ExecutionContext context{canceled, fidelity};
+
+    const auto parserResult = parse(code);
+
+    std::vector<LogMessage> messages;
+
+    std::copy(parserResult.errors.cbegin(), parserResult.errors.cend(), std::back_inserter(messages));
+    if (!parserResult.result) {
+        canceled->store(true);
+        return ExecutorResult{std::nullopt, parserResult.errors};
+    }
+
+    if (const auto root = std::get_if<ast::BlockExpr>(&parserResult.result->cinner())) {
+        context.setRoot(root, callbacks);
+    }
+
+    auto env = std::make_shared<Environment>(builtins);
+
+    std::optional<Value> result = eval(context, env, &*parserResult.result, 1);
+    const bool wasCanceled = context.isCanceled();
+    if (wasCanceled) {
+        result = std::nullopt;
+    }
+
+    const auto contextMessages = context.messages();
+    std::copy(contextMessages.cbegin(), contextMessages.cend(), std::back_inserter(messages));
+
+    canceled->store(true);
+    return ExecutorResult{result, messages, wasCanceled, context.isSimplified()};
+}
+
 }
 
 #define REGISTER_BUILTINS(NAME) { extern void add_builtins_##NAME(Environment &env); add_builtins_##NAME(*m_defaultEnvironment); }
@@ -26,48 +63,111 @@ Executor::Executor() {
     m_defaultEnvironment = std::make_shared<Environment>(nullptr);
 
     REGISTER_BUILTINS(chamfer_fillet);
+    REGISTER_BUILTINS(import);
     REGISTER_BUILTINS(make_2d);
     REGISTER_BUILTINS(make_3d);
     REGISTER_BUILTINS(primitives);
     REGISTER_BUILTINS(shape_manipulation);
 }
 
-ExecutorResult Executor::execute(const std::string &code) {
-    auto cancel = std::make_shared<std::atomic_bool>();
+Executor::~Executor() {
+    cancel();
 
-    auto cancelPrevious = m_cancelCurrent.exchange(cancel);
-    if (cancelPrevious) {
-        cancelPrevious->store(true);
+    {
+        std::unique_lock lock(m_queueLock);
+        m_stopping = true;
     }
 
-    ExecutionContext context{cancel};
+    m_queueChanged.notify_all();
 
-    const auto parserResult = parse(code);
+    // Queued runs are canceled, so the threads get through them quickly
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+}
 
-    std::vector<LogMessage> messages;
+std::shared_ptr<ExecutorRun> Executor::start(const std::string &code, ExecutorCallbacks callbacks, Fidelity fidelity) {
+    auto run = std::make_shared<ExecutorRun>();
+    run->m_canceled = addRun();
+
+    auto promise = std::make_shared<std::promise<ExecutorResult>>();
+    run->m_result = promise->get_future().share();
+
+    // The task only holds what the run needs, so that the handle does not have to outlive it
+    auto task = [environment = m_defaultEnvironment, code, callbacks = std::move(callbacks), fidelity,
+                 canceled = run->m_canceled, promise]() {
+        try {
+            promise->set_value(runCode(environment, code, canceled, callbacks, fidelity));
+        } catch (...) {
+            canceled->store(true);
+            promise->set_exception(std::current_exception());
+        }
+    };
 
-    std::copy(parserResult.errors.cbegin(), parserResult.errors.cend(), std::back_inserter(messages));
-    if (!parserResult.result) {
-        cancel->store(true);
-        return ExecutorResult{std::nullopt, parserResult.errors};
+    {
+        std::unique_lock lock(m_queueLock);
+        m_queue.push_back(std::move(task));
+
+        if (m_idleThreads == 0 && m_threads.size() < c_maxThreads) {
+            m_threads.emplace_back([this] { work(); });
+        }
     }
 
-    auto env = std::make_shared<Environment>(m_defaultEnvironment);
+    m_queueChanged.notify_one();
 
-    std::optional<Value> result = eval(context, env, &*parserResult.result, 1);
-    if (context.isCanceled()) {
-        result = std::nullopt;
+    return run;
+}
+
+void Executor::work() {
+    std::unique_lock lock(m_queueLock);
+
+    while (true) {
+        m_idleThreads++;
+        m_queueChanged.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+        m_idleThreads--;
+
+        if (m_queue.empty()) {
+            return;
+        }
+
+        auto task = std::move(m_queue.front());
+        m_queue.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
     }
+}
 
-    std::copy(context.messages().cbegin(), context.messages().cend(), std::back_inserter(messages));
+ExecutorResult Executor::execute(const std::string &code, ExecutorCallbacks callbacks, Fidelity fidelity) {
+    return runCode(m_defaultEnvironment, code, addRun(), callbacks, fidelity);
+}
 
-    cancel->store(true);
-    return ExecutorResult{result, messages};
+void Executor::cancel() {
+    std::unique_lock lock(m_runsLock);
+    for (const auto &run : m_runs) {
+        if (auto canceled = run.lock()) {
+            canceled->store(true);
+        }
+    }
 }
 
 bool Executor::isBusy() const {
-    auto cancelCurrent = m_cancelCurrent.load();
-    return cancelCurrent && !cancelCurrent->load();
+    std::unique_lock lock(m_runsLock);
+    return std::any_of(m_runs.cbegin(), m_runs.cend(), [](const auto &run) {
+        auto canceled = run.lock();
+        return canceled && !canceled->load();
+    });
+}
+
+std::shared_ptr<std::atomic_bool> Executor::addRun() {
+    auto canceled = std::make_shared<std::atomic_bool>();
+
+    std::unique_lock lock(m_runsLock);
+    std::erase_if(m_runs, [](const auto &run) { return run.expired(); });
+    m_runs.push_back(canceled);
+
+    return canceled;
 }
 
 namespace
@@ -146,15 +246,17 @@ Value eval(ExecutionContext &context, std::shared_ptr<Environment> env, const as
                 Value result = undefined;
                 ShapeList shapes;
 
-                for (const auto& expr : ex.exprs) {
+                for (size_t i = 0; i < ex.exprs.size(); i++) {
                     if (context.isCanceled()) {
                         return undefined;
                     }
 
-                    Value val = eval(context, env, &expr, recursionDepth);
+                    Value val = eval(context, env, &ex.exprs[i], recursionDepth);
+                    bool addedShapes = false;
                     if (val.is<ShapeList>()) {
                         auto list = val.as<ShapeList>();
                         std::move(list.cbegin(), list.cend(), std::back_inserter(shapes));
+                        addedShapes = !list.empty();
                     } else {
                         if (!shapes.empty() && !val.isUndefined()) {
                             context.addMessage(LogMessage::Level::Error, ex.span, "cannot return both shapes and a value");
@@ -163,6 +265,8 @@ Value eval(ExecutionContext &context, std::shared_ptr<Environment> env, const as
 
                         result = val;
                     }
+
+                    context.statementFinished(&ex, i + 1, ex.exprs.size(), shapes, addedShapes);
                 }
 
                 if (shapes.empty()) {
@@ -1,7 +1,15 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <thread>
+#include <vector>
 
 #include "logmessage.h"
 #include "value.h"
@@ -10,19 +18,85 @@ struct ExecutorResult
 {
     std::optional<Value> result;
     std::vector<LogMessage> messages;
+    bool canceled = false;
+    // Whether the run left out work because of its fidelity
+    bool simplified = false;
+};
+
+// How faithfully a run evaluates geometry
+enum class Fidelity {
+    // Expensive operations return boxes around their inputs instead of their result. Enough for diagnostics and a
+    // rough idea of where things are, in a fraction of the time.
+    Proxy,
+    // Fillets and chamfers are left out and combined shapes are returned as their overlaid operands, with the
+    // "preview" prop. For feedback while editing.
+    Preview,
+    Full,
+};
+
+// Called on the executing thread
+struct ExecutorCallbacks
+{
+    // With the shapes so far each time a top-level statement that produced shapes finishes, except for the last one
+    std::function<void(const ShapeList &)> onPartialResult;
+    // With the number of top-level statements finished and their total, after each of them
+    std::function<void(size_t, size_t)> onProgress;
+};
+
+// Handle to a run started with Executor::start. Canceling a run does not affect other runs of the same executor.
+class ExecutorRun
+{
+public:
+    // Blocks until the run has finished
+    const ExecutorResult &result() const { return m_result.get(); }
+    bool isFinished() const { return m_result.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+    void cancel() { m_canceled->store(true); }
+
+private:
+    std::shared_ptr<std::atomic_bool> m_canceled;
+    std::shared_future<ExecutorResult> m_result;
+
+    friend class Executor;
 };
 
 class ExecutionContext;
 class Environment;
 
+// Holds the builtins, which are shared read-only by all runs, so one executor can serve any number of concurrent runs.
+// Started runs execute on at most c_maxThreads threads owned by the executor. Destroying the executor cancels its runs
+// and waits for them.
 class Executor
 {
 public:
     Executor();
-    ExecutorResult execute(const std::string &code);
+    ~Executor();
+
+    // Queues a run for one of the executor's threads
+    std::shared_ptr<ExecutorRun> start(const std::string &code, ExecutorCallbacks callbacks = {}, Fidelity fidelity = Fidelity::Full);
+    // Runs on the calling thread
+    ExecutorResult execute(const std::string &code, ExecutorCallbacks callbacks = {}, Fidelity fidelity = Fidelity::Full);
+    // Cancels all runs in progress.
+    void cancel();
     bool isBusy() const;
 
 private:
-    std::atomic<std::shared_ptr<std::atomic_bool>> m_cancelCurrent;
+    // Canceled runs keep their thread until they notice, and some steps such as reading STEP never do, so the threads
+    // are capped to keep fast edits from piling up threads
+    static constexpr size_t c_maxThreads = 4;
+
+    std::shared_ptr<std::atomic_bool> addRun();
+    void work();
+
     std::shared_ptr<Environment> m_defaultEnvironment;
+    // Cancel flags of the runs, which are also set once a run finishes
+    mutable std::mutex m_runsLock;
+    std::vector<std::weak_ptr<std::atomic_bool>> m_runs;
+
+    // Started runs waiting for a thread. Threads are started as needed and exit when the executor is destroyed.
+    std::mutex m_queueLock;
+    std::condition_variable m_queueChanged;
+    std::deque<std::function<void()>> m_queue;
+    std::vector<std::thread> m_threads;
+    size_t m_idleThreads = 0;
+    bool m_stopping = false;
 };
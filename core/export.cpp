@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <random>
+#include <unordered_map>
+
+#include <Quantity_Color.hxx>
+#include <STEPCAFControl_Writer.hxx>
+#include <TDataStd_Name.hxx>
+#include <TDocStd_Document.hxx>
+#include <XCAFDoc_ColorTool.hxx>
+#include <XCAFDoc_DocumentTool.hxx>
+#include <XCAFDoc_ShapeTool.hxx>
+
+#include "export.h"
+#include "meshexport.h"
+#include "shapeio.h"
+#include "xdedocument.h"
+
+namespace
+{
+
+// Groups shapes into prototypes so that repeated geometry is written once. Shapes that share a TShape and orientation
+// are instances of one prototype, placed by their own location. Shapes that only look the same are not merged: the
+// geometry hash samples too few points to tell them apart for sure, and a wrong match would write wrong geometry.
+struct InstanceGrouping {
+    struct Prototype {
+        TopoDS_Shape shape;
+        std::vector<size_t> instances;
+    };
+
+    std::vector<Prototype> prototypes;
+
+    explicit InstanceGrouping(const ShapeList &shapes) {
+        std::unordered_map<const TopoDS_TShape *, std::vector<size_t>> byTShape;
+
+        for (size_t i = 0; i < shapes.size(); i++) {
+            const auto &shape = shapes[i].shape();
+            if (shape.IsNull()) {
+                continue;
+            }
+
+            const auto unlocated = shape.Located(TopLoc_Location{});
+
+            auto &sameTShape = byTShape[shape.TShape().get()];
+            auto proto = std::find_if(sameTShape.begin(), sameTShape.end(), [&](size_t p) {
+                return prototypes[p].shape.Orientation() == unlocated.Orientation();
+            });
+
+            if (proto != sameTShape.end()) {
+                prototypes[*proto].instances.push_back(i);
+                continue;
+            }
+
+            sameTShape.push_back(prototypes.size());
+            prototypes.push_back(Prototype{unlocated, {i}});
+        }
+    }
+};
+
+void setLabelName(const TDF_Label &label, const Shape &shape) {
+    const auto name = shape.getProp("name").as<std::string>();
+    if (!name.empty()) {
+        TDataStd_Name::Set(label, TCollection_ExtendedString(name.c_str(), true));
+    }
+}
+
+ExportResult exportStep(const std::string &path, const ShapeList &shapes, const Message_ProgressRange &progress) {
+    XdeDocument doc;
+
+    auto shapeTool = XCAFDoc_DocumentTool::ShapeTool(doc->Main());
+    auto colorTool = XCAFDoc_DocumentTool::ColorTool(doc->Main());
+
+    const auto root = shapeTool->NewShape();
+    TDataStd_Name::Set(root, "pollocad");
+
+    InstanceGrouping grouping{shapes};
+    for (const auto &proto : grouping.prototypes) {
+        const auto protoLabel = shapeTool->AddShape(proto.shape, false);
+
+        for (const auto index : proto.instances) {
+            const auto &shape = shapes[index];
+            const auto instanceLabel = shapeTool->AddComponent(root, protoLabel, shape.shape().Location());
+
+            setLabelName(instanceLabel, shape);
+
+            const auto colorName = shape.getProp("color").as<std::string>();
+            Quantity_Color color;
+            if (!colorName.empty() && (Quantity_Color::ColorFromHex(colorName.c_str(), color) || Quantity_Color::ColorFromName(colorName.c_str(), color))) {
+                colorTool->SetColor(instanceLabel, color, XCAFDoc_ColorGen);
+            }
+        }
+
+        if (proto.instances.size() == 1) {
+            setLabelName(protoLabel, shapes[proto.instances.front()]);
+        }
+    }
+
+    shapeTool->UpdateAssemblies();
+
+    STEPCAFControl_Writer writer;
+    writer.SetColorMode(true);
+    writer.SetNameMode(true);
+
+    ExportResult result{true, {}};
+    if (!writer.Transfer(doc.get(), STEPControl_AsIs, nullptr, progress)) {
+        result = {false, progress.UserBreak() ? "canceled" : "STEP transfer failed"};
+    } else if (writer.Write(path.c_str()) != IFSelect_RetDone) {
+        result = {false, "cannot write STEP file"};
+    }
+
+    return result;
+}
+
+ExportResult exportPcBrep(const std::string &path, const ShapeList &shapes, const Message_ProgressRange &progress) {
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    if (!os) {
+        return {false, "cannot open file for writing"};
+    }
+
+    writeShapes(os, shapes, progress);
+    os.close();
+    if (progress.UserBreak()) {
+        return {false, "canceled"};
+    } else if (!os) {
+        return {false, "write failed"};
+    }
+
+    return {true, {}};
+}
+
+}
+
+ExportResult exportShapes(const std::string &path, const ShapeList &shapes, const ExportOptions &options, const Message_ProgressRange &progress) {
+    auto ext = std::filesystem::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char ch) { return std::tolower(ch); });
+
+    // Writes go to a temporary file next to the target, which replaces the target only once complete, so that a
+    // canceled or failed export never leaves a truncated file behind or destroys an earlier export.
+    std::random_device random;
+    auto tmpPath = std::filesystem::path(path);
+    tmpPath.replace_filename(std::format(".{}.{:08x}.tmp", tmpPath.filename().string(), random()));
+    const auto tmp = tmpPath.string();
+
+    ExportResult result;
+    if (ext == ".step" || ext == ".stp") {
+        result = exportStep(tmp, shapes, progress);
+    } else if (ext == ".pcbrep") {
+        result = exportPcBrep(tmp, shapes, progress);
+    } else if (ext == ".stl") {
+        result = exportStl(tmp, shapes, options, progress);
+    } else if (ext == ".3mf") {
+        result = export3mf(tmp, shapes, options, progress);
+    } else {
+        return {false, "unsupported file type"};
+    }
+
+    std::error_code ec;
+    if (result.ok) {
+        std::filesystem::rename(tmpPath, path, ec);
+        if (ec) {
+            result = {false, "cannot replace " + path + ": " + ec.message()};
+        }
+    }
+
+    if (!result.ok) {
+        std::filesystem::remove(tmpPath, ec);
+    }
+
+    return result;
+}
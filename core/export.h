@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+#include <Message_ProgressRange.hxx>
+
+#include "value.h"
+
+struct ExportOptions {
+    // Chordal and angular deflection for mesh formats. Shapes can override the chordal deflection with a
+    // "deflection" prop.
+    double deflection = 0.05;
+    double angularDeflection = 0.5;
+};
+
+struct ExportResult {
+    bool ok = false;
+    std::string error;
+};
+
+// Writes shapes to a file in the format implied by the file extension:
+// - .step/.stp: STEP
+// - .pcbrep: binary BRep with pollocad props and spans, readable with import()
+// - .stl: binary STL
+// - .3mf: 3MF with one object per shape
+// Progress is reported through the range, and an export canceled through it fails with "canceled".
+ExportResult exportShapes(const std::string &path, const ShapeList &shapes, const ExportOptions &options = {}, const Message_ProgressRange &progress = {});
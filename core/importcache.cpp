@@ -0,0 +1,111 @@
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include <OSD_Parallel.hxx>
+
+#include "importcache.h"
+#include "shapeio.h"
+
+namespace
+{
+
+const size_t c_hashChunkSize = 16 * 1024 * 1024;
+
+uint64_t hashChunk(std::string_view data) {
+    uint64_t h = 0xcbf29ce484222325ull;
+
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data.data() + i, sizeof(word));
+        h = (h ^ word) * 0x100000001b3ull;
+        h ^= h >> 29;
+    }
+
+    for (; i < data.size(); i++) {
+        h = (h ^ static_cast<uint8_t>(data[i])) * 0x100000001b3ull;
+    }
+
+    return h;
+}
+
+std::filesystem::path cacheDirectory() {
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return std::filesystem::path(xdg) / "pollocad" / "import";
+    }
+
+    if (const char *home = std::getenv("HOME"); home && *home) {
+        return std::filesystem::path(home) / ".cache" / "pollocad" / "import";
+    }
+
+    return std::filesystem::temp_directory_path() / "pollocad" / "import";
+}
+
+std::filesystem::path cachePath(uint64_t hash) {
+    return cacheDirectory() / std::format("{:016x}.pcshapes", hash);
+}
+
+}
+
+uint64_t contentHash(std::string_view data) {
+    const size_t chunks = (data.size() + c_hashChunkSize - 1) / c_hashChunkSize;
+
+    std::vector<uint64_t> chunkHashes(chunks);
+    OSD_Parallel::For(0, static_cast<int>(chunks), [&](int i) {
+        chunkHashes[i] = hashChunk(data.substr(i * c_hashChunkSize, c_hashChunkSize));
+    });
+
+    uint64_t h = data.size();
+    for (const auto ch : chunkHashes) {
+        h = (h ^ ch) * 0x100000001b3ull;
+        h ^= h >> 31;
+    }
+
+    return h;
+}
+
+std::optional<ShapeList> loadImportCache(uint64_t hash) {
+    std::ifstream is(cachePath(hash), std::ios::binary);
+    if (!is) {
+        return std::nullopt;
+    }
+
+    return readShapes(is);
+}
+
+void storeImportCache(uint64_t hash, const ShapeList &shapes) {
+    std::error_code ec;
+
+    const auto path = cachePath(hash);
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec) {
+        return;
+    }
+
+    // Write to a temporary file first so that a crash never leaves a truncated cache entry behind. The name is unique
+    // because concurrent runs may store the same entry.
+    std::random_device random;
+    auto tmpPath = path;
+    tmpPath += std::format(".{:08x}{:08x}.tmp", random(), random());
+
+    {
+        std::ofstream os(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!os) {
+            return;
+        }
+
+        writeShapes(os, shapes);
+        if (!os) {
+            os.close();
+            std::filesystem::remove(tmpPath, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, path, ec);
+}
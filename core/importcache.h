@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "value.h"
+
+// Hash of file contents used as the import cache key. Large inputs are hashed in parallel chunks.
+uint64_t contentHash(std::string_view data);
+
+// On-disk cache of translated imports, stored as binary BRep with props under the user cache directory.
+std::optional<ShapeList> loadImportCache(uint64_t hash);
+void storeImportCache(uint64_t hash, const ShapeList &shapes);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <iosfwd>
 
@@ -38,3 +39,7 @@ struct LogMessage
     std::string message;
     Span span;
 };
+
+// A run reports at most this many messages from execution. The first ones are kept, and the rest are counted in one
+// more message at the end.
+constexpr size_t c_maxMessages = 1000;
@@ -0,0 +1,49 @@
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mappedfile.h"
+
+MappedFile::MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        m_error = std::strerror(errno);
+        return;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+        m_error = std::strerror(errno);
+        ::close(fd);
+        return;
+    }
+
+    m_size = static_cast<size_t>(st.st_size);
+
+    if (m_size > 0) {
+        void *ptr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            m_error = std::strerror(errno);
+            m_size = 0;
+            ::close(fd);
+            return;
+        }
+
+        ::madvise(ptr, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char *>(ptr);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    m_open = true;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        ::munmap(const_cast<char *>(m_data), m_size);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of an entire file. The mapping lives as long as the object.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path);
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    bool isOpen() const { return m_open; }
+    const std::string &error() const { return m_error; }
+
+    std::string_view data() const { return {m_data, m_size}; }
+
+private:
+    bool m_open = false;
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    std::string m_error;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <istream>
+#include <streambuf>
+#include <string_view>
+
+// Input stream that reads directly from a block of memory without copying it.
+class MemoryStreamBuf : public std::streambuf {
+public:
+    explicit MemoryStreamBuf(std::string_view data) {
+        auto begin = const_cast<char *>(data.data());
+        setg(begin, begin, begin + data.size());
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        if (!(which & std::ios_base::in)) {
+            return pos_type(off_type(-1));
+        }
+
+        char *base = dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr();
+        char *target = base + off;
+        if (target < eback() || target > egptr()) {
+            return pos_type(off_type(-1));
+        }
+
+        setg(eback(), target, egptr());
+        return pos_type(target - eback());
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+class MemoryStream : public std::istream {
+public:
+    explicit MemoryStream(std::string_view data) : std::istream(&m_buf), m_buf(data) { }
+
+private:
+    MemoryStreamBuf m_buf;
+};
@@ -0,0 +1,438 @@
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <BRep_Builder.hxx>
+#include <BRep_Tool.hxx>
+#include <BRepMesh_IncrementalMesh.hxx>
+#include <BRepTools.hxx>
+#include <Geom_Circle.hxx>
+#include <Geom_ConicalSurface.hxx>
+#include <Geom_CylindricalSurface.hxx>
+#include <Geom_Ellipse.hxx>
+#include <Geom_Line.hxx>
+#include <Geom_Plane.hxx>
+#include <Geom_SphericalSurface.hxx>
+#include <Geom_ToroidalSurface.hxx>
+#include <Precision.hxx>
+#include <Poly_PolygonOnTriangulation.hxx>
+#include <Poly_Triangulation.hxx>
+#include <TopExp.hxx>
+#include <TopExp_Explorer.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+#include <TopoDS.hxx>
+
+#include "meshcache.h"
+#include "shapehash.h"
+
+namespace
+{
+
+const size_t c_maxCachedTriangles = 4'000'000;
+
+// An edge of a cached face, in the TFace's frame. Faces with the same surface and corners can still differ in the
+// curves between the corners.
+struct EdgeSignature {
+    Handle(Geom_Curve) curve;
+    gp_Trsf curveLocation;
+    double first = 0.0;
+    double last = 0.0;
+    // Range of the edge's curve on the face's surface
+    double surfaceFirst = 0.0;
+    double surfaceLast = 0.0;
+    TopAbs_Orientation orientation = TopAbs_FORWARD;
+};
+
+// What a cached triangulation was made for. A key match is only restored if the face matches all of it, so that a hash
+// collision cannot put another face's mesh in place.
+struct FaceSignature {
+    Handle(Geom_Surface) surface;
+    // Placement of the surface in the TFace, and of the face in the meshed shape
+    gp_Trsf surfaceLocation;
+    gp_Trsf location;
+    double bounds[4];
+    // In the TFace's frame
+    std::vector<gp_Pnt> vertices;
+    // In explorer order
+    std::vector<EdgeSignature> edges;
+};
+
+struct CachedMesh {
+    FaceSignature signature;
+    Handle(Poly_Triangulation) triangulation;
+    // Polygons of the face's edges in explorer order, so that face boundaries can be drawn and neighbouring faces
+    // meshed later share the boundary nodes
+    std::vector<Handle(Poly_PolygonOnTriangulation)> edges;
+};
+
+class MeshCache {
+public:
+    std::optional<CachedMesh> find(size_t key, double deflection) {
+        std::lock_guard lock(m_mutex);
+
+        auto it = m_entries.find(key);
+        if (it == m_entries.end() || it->second->second.triangulation->Deflection() > deflection) {
+            return std::nullopt;
+        }
+
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return it->second->second;
+    }
+
+    void insert(size_t key, CachedMesh mesh) {
+        std::lock_guard lock(m_mutex);
+
+        if (auto it = m_entries.find(key); it != m_entries.end()) {
+            m_triangles -= it->second->second.triangulation->NbTriangles();
+            m_lru.erase(it->second);
+            m_entries.erase(it);
+        }
+
+        m_triangles += mesh.triangulation->NbTriangles();
+        m_lru.emplace_front(key, std::move(mesh));
+        m_entries[key] = m_lru.begin();
+
+        while (m_triangles > c_maxCachedTriangles && m_lru.size() > 1) {
+            const auto &[oldKey, oldMesh] = m_lru.back();
+            m_triangles -= oldMesh.triangulation->NbTriangles();
+            m_entries.erase(oldKey);
+            m_lru.pop_back();
+        }
+    }
+
+private:
+    using Entry = std::pair<size_t, CachedMesh>;
+
+    std::mutex m_mutex;
+    std::list<Entry> m_lru;
+    std::unordered_map<size_t, std::list<Entry>::iterator> m_entries;
+    size_t m_triangles = 0;
+};
+
+MeshCache s_meshCache;
+
+// Locks of the shapes registered with registerSharedShape, by the TShapes of their faces and edges
+class SharedShapeLocks {
+public:
+    void add(const TopoDS_Shape &shape) {
+        auto mutex = std::make_shared<std::mutex>();
+
+        std::lock_guard guard(m_mutex);
+        for (const auto type : {TopAbs_FACE, TopAbs_EDGE}) {
+            for (TopExp_Explorer ex(shape, type); ex.More(); ex.Next()) {
+                m_locks.emplace(ex.Current().TShape().get(), mutex);
+            }
+        }
+    }
+
+    // Locks every registered shape that shares a face or an edge with the shape. Locks are taken in address order so
+    // that concurrent callers cannot deadlock.
+    std::vector<std::unique_lock<std::mutex>> lock(const TopoDS_Shape &shape) {
+        std::vector<std::mutex *> mutexes;
+        {
+            std::lock_guard guard(m_mutex);
+            if (m_locks.empty()) {
+                return {};
+            }
+
+            for (const auto type : {TopAbs_FACE, TopAbs_EDGE}) {
+                for (TopExp_Explorer ex(shape, type); ex.More(); ex.Next()) {
+                    if (auto it = m_locks.find(ex.Current().TShape().get()); it != m_locks.end()) {
+                        mutexes.push_back(it->second.get());
+                    }
+                }
+            }
+        }
+
+        std::sort(mutexes.begin(), mutexes.end());
+        mutexes.erase(std::unique(mutexes.begin(), mutexes.end()), mutexes.end());
+
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(mutexes.size());
+        for (const auto mutex : mutexes) {
+            locks.emplace_back(*mutex);
+        }
+
+        return locks;
+    }
+
+private:
+    std::mutex m_mutex;
+    // Registered shapes are never released, so their TShapes stay valid keys
+    std::unordered_map<const TopoDS_TShape *, std::shared_ptr<std::mutex>> m_locks;
+};
+
+SharedShapeLocks s_sharedShapeLocks;
+
+FaceSignature signatureOf(const TopoDS_Face &face) {
+    const auto unlocated = TopoDS::Face(face.Located(TopLoc_Location{}));
+
+    FaceSignature signature;
+    TopLoc_Location surfaceLocation;
+    signature.surface = BRep_Tool::Surface(unlocated, surfaceLocation);
+    signature.surfaceLocation = surfaceLocation.Transformation();
+    signature.location = face.Location().Transformation();
+    BRepTools::UVBounds(unlocated, signature.bounds[0], signature.bounds[1], signature.bounds[2], signature.bounds[3]);
+
+    for (TopExp_Explorer ex(unlocated, TopAbs_VERTEX); ex.More(); ex.Next()) {
+        signature.vertices.push_back(BRep_Tool::Pnt(TopoDS::Vertex(ex.Current())));
+    }
+
+    for (TopExp_Explorer ex(unlocated, TopAbs_EDGE); ex.More(); ex.Next()) {
+        const auto &edge = TopoDS::Edge(ex.Current());
+
+        EdgeSignature edgeSignature;
+        TopLoc_Location curveLocation;
+        edgeSignature.curve = BRep_Tool::Curve(edge, curveLocation, edgeSignature.first, edgeSignature.last);
+        edgeSignature.curveLocation = curveLocation.Transformation();
+        BRep_Tool::Range(edge, unlocated, edgeSignature.surfaceFirst, edgeSignature.surfaceLast);
+        edgeSignature.orientation = edge.Orientation();
+        signature.edges.push_back(edgeSignature);
+    }
+
+    return signature;
+}
+
+bool isSameTrsf(const gp_Trsf &a, const gp_Trsf &b) {
+    for (int row = 1; row <= 3; row++) {
+        for (int col = 1; col <= 4; col++) {
+            if (std::abs(a.Value(row, col) - b.Value(row, col)) > Precision::Confusion()) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool isSameAxes(const gp_Ax3 &a, const gp_Ax3 &b) {
+    return a.Direct() == b.Direct() && a.Location().IsEqual(b.Location(), Precision::Confusion())
+        && a.Direction().IsEqual(b.Direction(), Precision::Angular())
+        && a.XDirection().IsEqual(b.XDirection(), Precision::Angular());
+}
+
+bool isSameValue(double a, double b) {
+    return std::abs(a - b) <= Precision::Confusion();
+}
+
+// The same handle, or elementary surfaces with the same definition, as built again by a later run. Other surfaces are
+// only compared by identity.
+bool isSameSurface(const Handle(Geom_Surface) &a, const Handle(Geom_Surface) &b) {
+    if (a == b) {
+        return true;
+    }
+
+    if (a.IsNull() || b.IsNull() || a->DynamicType() != b->DynamicType()) {
+        return false;
+    }
+
+    if (auto pa = Handle(Geom_Plane)::DownCast(a)) {
+        return isSameAxes(pa->Position(), Handle(Geom_Plane)::DownCast(b)->Position());
+    }
+
+    if (auto ca = Handle(Geom_CylindricalSurface)::DownCast(a)) {
+        auto cb = Handle(Geom_CylindricalSurface)::DownCast(b);
+        return isSameAxes(ca->Position(), cb->Position()) && isSameValue(ca->Radius(), cb->Radius());
+    }
+
+    if (auto ca = Handle(Geom_ConicalSurface)::DownCast(a)) {
+        auto cb = Handle(Geom_ConicalSurface)::DownCast(b);
+        return isSameAxes(ca->Position(), cb->Position()) && isSameValue(ca->RefRadius(), cb->RefRadius())
+            && std::abs(ca->SemiAngle() - cb->SemiAngle()) <= Precision::Angular();
+    }
+
+    if (auto sa = Handle(Geom_SphericalSurface)::DownCast(a)) {
+        auto sb = Handle(Geom_SphericalSurface)::DownCast(b);
+        return isSameAxes(sa->Position(), sb->Position()) && isSameValue(sa->Radius(), sb->Radius());
+    }
+
+    if (auto ta = Handle(Geom_ToroidalSurface)::DownCast(a)) {
+        auto tb = Handle(Geom_ToroidalSurface)::DownCast(b);
+        return isSameAxes(ta->Position(), tb->Position()) && isSameValue(ta->MajorRadius(), tb->MajorRadius())
+            && isSameValue(ta->MinorRadius(), tb->MinorRadius());
+    }
+
+    return false;
+}
+
+// Like isSameSurface, for the curves of edges
+bool isSameCurve(const Handle(Geom_Curve) &a, const Handle(Geom_Curve) &b) {
+    if (a == b) {
+        return true;
+    }
+
+    if (a.IsNull() || b.IsNull() || a->DynamicType() != b->DynamicType()) {
+        return false;
+    }
+
+    if (auto la = Handle(Geom_Line)::DownCast(a)) {
+        const auto &pa = la->Position();
+        const auto &pb = Handle(Geom_Line)::DownCast(b)->Position();
+        return pa.Location().IsEqual(pb.Location(), Precision::Confusion())
+            && pa.Direction().IsEqual(pb.Direction(), Precision::Angular());
+    }
+
+    if (auto ca = Handle(Geom_Circle)::DownCast(a)) {
+        auto cb = Handle(Geom_Circle)::DownCast(b);
+        return isSameAxes(gp_Ax3{ca->Position()}, gp_Ax3{cb->Position()}) && isSameValue(ca->Radius(), cb->Radius());
+    }
+
+    if (auto ea = Handle(Geom_Ellipse)::DownCast(a)) {
+        auto eb = Handle(Geom_Ellipse)::DownCast(b);
+        return isSameAxes(gp_Ax3{ea->Position()}, gp_Ax3{eb->Position()})
+            && isSameValue(ea->MajorRadius(), eb->MajorRadius()) && isSameValue(ea->MinorRadius(), eb->MinorRadius());
+    }
+
+    return false;
+}
+
+bool matches(const EdgeSignature &a, const EdgeSignature &b) {
+    return a.orientation == b.orientation && isSameCurve(a.curve, b.curve)
+        && isSameTrsf(a.curveLocation, b.curveLocation) && std::abs(a.first - b.first) <= Precision::PConfusion()
+        && std::abs(a.last - b.last) <= Precision::PConfusion()
+        && std::abs(a.surfaceFirst - b.surfaceFirst) <= Precision::PConfusion()
+        && std::abs(a.surfaceLast - b.surfaceLast) <= Precision::PConfusion();
+}
+
+bool matches(const FaceSignature &a, const FaceSignature &b) {
+    if (!isSameSurface(a.surface, b.surface) || !isSameTrsf(a.surfaceLocation, b.surfaceLocation)
+        || !isSameTrsf(a.location, b.location) || a.vertices.size() != b.vertices.size()
+        || a.edges.size() != b.edges.size()) {
+        return false;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (std::abs(a.bounds[i] - b.bounds[i]) > Precision::PConfusion()) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < a.vertices.size(); i++) {
+        if (!a.vertices[i].IsEqual(b.vertices[i], Precision::Confusion())) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < a.edges.size(); i++) {
+        if (!matches(a.edges[i], b.edges[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// faceGeometryHash combined with the face's placement in the meshed shape
+size_t cacheKey(const TopoDS_Face &face) {
+    size_t h = faceGeometryHash(face);
+
+    const auto &trsf = face.Location().Transformation();
+    for (int row = 1; row <= 3; row++) {
+        for (int col = 1; col <= 4; col++) {
+            const auto q = static_cast<int64_t>(std::llround(trsf.Value(row, col) / Precision::Confusion()));
+            h ^= std::hash<int64_t>{}(q) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        }
+    }
+
+    return h;
+}
+
+bool restore(const TopoDS_Face &face, const CachedMesh &mesh) {
+    std::vector<TopoDS_Edge> edges;
+    for (TopExp_Explorer ex(face, TopAbs_EDGE); ex.More(); ex.Next()) {
+        edges.push_back(TopoDS::Edge(ex.Current()));
+    }
+
+    if (edges.size() != mesh.edges.size()) {
+        return false;
+    }
+
+    BRep_Builder builder;
+    builder.UpdateFace(face, mesh.triangulation);
+    for (size_t i = 0; i < edges.size(); i++) {
+        builder.UpdateEdge(edges[i], mesh.edges[i], mesh.triangulation, face.Location());
+    }
+
+    return true;
+}
+
+std::optional<CachedMesh> extract(const TopoDS_Face &face, FaceSignature signature) {
+    TopLoc_Location location;
+    CachedMesh mesh;
+    mesh.signature = std::move(signature);
+    mesh.triangulation = BRep_Tool::Triangulation(face, location);
+    if (mesh.triangulation.IsNull()) {
+        return std::nullopt;
+    }
+
+    for (TopExp_Explorer ex(face, TopAbs_EDGE); ex.More(); ex.Next()) {
+        auto polygon = BRep_Tool::PolygonOnTriangulation(TopoDS::Edge(ex.Current()), mesh.triangulation, location);
+        if (polygon.IsNull()) {
+            return std::nullopt;
+        }
+
+        mesh.edges.push_back(polygon);
+    }
+
+    return mesh;
+}
+
+}
+
+void meshWithCache(const TopoDS_Shape &shape, double deflection, double angularDeflection) {
+    if (shape.IsNull()) {
+        return;
+    }
+
+    const auto sharedLocks = s_sharedShapeLocks.lock(shape);
+
+    TopTools_IndexedMapOfShape faces;
+    TopExp::MapShapes(shape, TopAbs_FACE, faces);
+
+    struct Meshed {
+        TopoDS_Face face;
+        size_t key;
+        FaceSignature signature;
+    };
+
+    std::vector<Meshed> meshed;
+    for (int i = 1; i <= faces.Extent(); i++) {
+        const auto &face = TopoDS::Face(faces(i));
+
+        TopLoc_Location location;
+        const auto &existing = BRep_Tool::Triangulation(face, location);
+        if (!existing.IsNull() && existing->Deflection() <= deflection) {
+            continue;
+        }
+
+        const auto key = cacheKey(face);
+        auto signature = signatureOf(face);
+        if (auto cached = s_meshCache.find(key, deflection);
+            cached && matches(cached->signature, signature) && restore(face, *cached)) {
+            continue;
+        }
+
+        meshed.push_back(Meshed{face, key, std::move(signature)});
+    }
+
+    if (meshed.empty()) {
+        return;
+    }
+
+    BRepMesh_IncrementalMesh(shape, deflection, false, angularDeflection, false);
+
+    for (auto &[face, key, signature] : meshed) {
+        if (auto mesh = extract(face, std::move(signature))) {
+            s_meshCache.insert(key, std::move(*mesh));
+        }
+    }
+}
+
+void registerSharedShape(const TopoDS_Shape &shape) {
+    s_sharedShapeLocks.add(shape);
+}
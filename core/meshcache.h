@@ -0,0 +1,16 @@
+#pragma once
+
+#include <TopoDS_Shape.hxx>
+
+// Meshes a shape with BRepMesh_IncrementalMesh, first reusing triangulations of faces whose geometry was meshed before
+// at the same or a finer deflection, so that only new or changed faces are meshed.
+// Triangulations are cached per face geometry (see faceGeometryHash) and location in a process-wide LRU cache bounded
+// by triangle count. Since the hash can collide, a cached triangulation is only used for a face with the same surface
+// definition, UV bounds, vertices, edge curves and location as the face it was made for.
+// Meshing writes into the shape's TFaces and TEdges, so callers must not mesh shapes that share them in parallel, with
+// the exception of registered shapes.
+void meshWithCache(const TopoDS_Shape &shape, double deflection, double angularDeflection);
+
+// Registers a shape that outlives runs, such as the embedded pollo, and so may be in the results of concurrent runs.
+// meshWithCache serializes meshing of shapes that share faces or edges with it.
+void registerSharedShape(const TopoDS_Shape &shape);
@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <array>
+#include <format>
+#include <fstream>
+
+#include <BRep_Tool.hxx>
+#include <BRepBuilderAPI_Copy.hxx>
+#include <BRepTools.hxx>
+#include <Message_ProgressScope.hxx>
+#include <OSD_Parallel.hxx>
+#include <Poly_Triangulation.hxx>
+#include <Precision.hxx>
+#include <Quantity_Color.hxx>
+#include <TopExp_Explorer.hxx>
+#include <TopoDS.hxx>
+
+#include "meshcache.h"
+#include "meshexport.h"
+#include "vertexwelder.h"
+#include "zipwriter.h"
+
+namespace
+{
+
+double shapeDeflection(const Shape &shape, const ExportOptions &options) {
+    const auto prop = shape.getProp("deflection");
+    if (prop.is<double>() && prop.as<double>() > 0.0) {
+        return prop.as<double>();
+    }
+
+    return options.deflection;
+}
+
+// Returns the shape itself if it is already triangulated finely enough, otherwise a meshed topological copy. Meshing
+// a copy leaves the shapes shared with the viewer untouched and lets the triangulation be freed after writing.
+TopoDS_Shape meshedShape(const Shape &shape, const ExportOptions &options) {
+    if (shape.shape().IsNull()) {
+        return {};
+    }
+
+    const double deflection = shapeDeflection(shape, options);
+    if (BRepTools::Triangulation(shape.shape(), deflection)) {
+        return shape.shape();
+    }
+
+    auto copy = BRepBuilderAPI_Copy(shape.shape(), false, false).Shape();
+    meshWithCache(copy, deflection, options.angularDeflection);
+    return copy;
+}
+
+// Calls write(shape, meshedShape) for every shape in order, meshing one batch in parallel at a time. Returns false if
+// canceled.
+template <typename Write>
+bool forEachMeshed(const ShapeList &shapes, const ExportOptions &options, const Message_ProgressRange &progress, Write &&write) {
+    const size_t batchSize = std::max<size_t>(64, OSD_Parallel::NbLogicalProcessors() * 4);
+
+    Message_ProgressScope scope(progress, "Meshing", static_cast<double>(shapes.size()));
+
+    std::vector<TopoDS_Shape> batch;
+    for (size_t start = 0; start < shapes.size(); start += batchSize) {
+        if (!scope.More()) {
+            return false;
+        }
+
+        const size_t count = std::min(batchSize, shapes.size() - start);
+
+        batch.assign(count, TopoDS_Shape{});
+        OSD_Parallel::For(0, static_cast<int>(count), [&](int i) {
+            batch[i] = meshedShape(shapes[start + i], options);
+        });
+
+        for (size_t i = 0; i < count; i++) {
+            write(shapes[start + i], batch[i]);
+        }
+
+        scope.Next(static_cast<double>(count));
+    }
+
+    return scope.More();
+}
+
+// Calls f(triangulation, location, reversed) for every triangulated face
+template <typename F>
+void forEachFaceTriangulation(const TopoDS_Shape &shape, F &&f) {
+    for (TopExp_Explorer ex(shape, TopAbs_FACE); ex.More(); ex.Next()) {
+        const auto &face = TopoDS::Face(ex.Current());
+
+        TopLoc_Location location;
+        const auto tri = BRep_Tool::Triangulation(face, location);
+        if (tri.IsNull()) {
+            continue;
+        }
+
+        f(*tri, location.Transformation(), face.Orientation() == TopAbs_REVERSED);
+    }
+}
+
+void writeFloats(std::ostream &os, const gp_XYZ &v) {
+    const float f[3] = {static_cast<float>(v.X()), static_cast<float>(v.Y()), static_cast<float>(v.Z())};
+    os.write(reinterpret_cast<const char *>(f), sizeof(f));
+}
+
+std::string colorHex(const Shape &shape) {
+    const auto name = shape.getProp("color").as<std::string>();
+    if (name.empty()) {
+        return {};
+    }
+
+    Quantity_Color color;
+    if (!Quantity_Color::ColorFromHex(name.c_str(), color) && !Quantity_Color::ColorFromName(name.c_str(), color)) {
+        return {};
+    }
+
+    return Quantity_Color::ColorToHex(color).ToCString();
+}
+
+}
+
+ExportResult exportStl(const std::string &path, const ShapeList &shapes, const ExportOptions &options, const Message_ProgressRange &progress) {
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    if (!os) {
+        return {false, "cannot open file for writing"};
+    }
+
+    char header[80] = "pollocad";
+    os.write(header, sizeof(header));
+
+    // Triangle count is patched in at the end
+    uint32_t count = 0;
+    os.write(reinterpret_cast<const char *>(&count), sizeof(count));
+
+    const bool completed = forEachMeshed(shapes, options, progress, [&](const Shape &, const TopoDS_Shape &meshed) {
+        forEachFaceTriangulation(meshed, [&](const Poly_Triangulation &tri, const gp_Trsf &trsf, bool reversed) {
+            for (int i = 1; i <= tri.NbTriangles(); i++) {
+                int n1, n2, n3;
+                tri.Triangle(i).Get(n1, n2, n3);
+                if (reversed) {
+                    std::swap(n2, n3);
+                }
+
+                const auto p1 = tri.Node(n1).Transformed(trsf).XYZ();
+                const auto p2 = tri.Node(n2).Transformed(trsf).XYZ();
+                const auto p3 = tri.Node(n3).Transformed(trsf).XYZ();
+
+                auto normal = (p2 - p1).Crossed(p3 - p1);
+                const double length = normal.Modulus();
+                normal = length > gp::Resolution() ? normal / length : gp_XYZ{};
+
+                writeFloats(os, normal);
+                writeFloats(os, p1);
+                writeFloats(os, p2);
+                writeFloats(os, p3);
+
+                const uint16_t attributes = 0;
+                os.write(reinterpret_cast<const char *>(&attributes), sizeof(attributes));
+
+                count++;
+            }
+        });
+    });
+
+    if (!completed) {
+        return {false, "canceled"};
+    }
+
+    os.seekp(80);
+    os.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    os.close();
+
+    if (!os) {
+        return {false, "write failed"};
+    }
+
+    return {true, {}};
+}
+
+ExportResult export3mf(const std::string &path, const ShapeList &shapes, const ExportOptions &options, const Message_ProgressRange &progress) {
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    if (!os) {
+        return {false, "cannot open file for writing"};
+    }
+
+    ZipWriter zip(os);
+
+    zip.beginEntry("[Content_Types].xml");
+    zip.write(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+        "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+        "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>"
+        "</Types>\n");
+    zip.endEntry();
+
+    zip.beginEntry("_rels/.rels");
+    zip.write(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+        "<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>"
+        "</Relationships>\n");
+    zip.endEntry();
+
+    zip.beginEntry("3D/3dmodel.model");
+    zip.write(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<model unit=\"millimeter\" xml:lang=\"en-US\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+        "<resources>\n");
+
+    // Colors become base materials that objects refer to by index. Material ids never collide with object ids
+    // because objects are numbered from 2.
+    std::vector<std::string> colors;
+    for (const auto &sh : shapes) {
+        auto color = colorHex(sh);
+        if (!color.empty() && std::find(colors.begin(), colors.end(), color) == colors.end()) {
+            colors.push_back(color);
+        }
+    }
+
+    if (!colors.empty()) {
+        zip.write("<basematerials id=\"1\">\n");
+        for (const auto &color : colors) {
+            zip.write(std::format("<base name=\"{}\" displaycolor=\"{}\"/>\n", color, color));
+        }
+        zip.write("</basematerials>\n");
+    }
+
+    std::string buf;
+    int objectId = 2;
+    std::vector<int> objectIds;
+    std::vector<uint32_t> nodeIndices;
+    std::vector<std::array<uint32_t, 3>> triangles;
+
+    const bool completed = forEachMeshed(shapes, options, progress, [&](const Shape &shape, const TopoDS_Shape &meshed) {
+        buf.clear();
+        triangles.clear();
+
+        // Faces each have their own copy of their boundary nodes. Welding them makes the object one connected mesh,
+        // which is what makes it manifold.
+        VertexWelder welder{Precision::Confusion()};
+        forEachFaceTriangulation(meshed, [&](const Poly_Triangulation &tri, const gp_Trsf &trsf, bool reversed) {
+            nodeIndices.resize(tri.NbNodes());
+            for (int i = 1; i <= tri.NbNodes(); i++) {
+                nodeIndices[i - 1] = welder.add(tri.Node(i).Transformed(trsf));
+            }
+
+            for (int i = 1; i <= tri.NbTriangles(); i++) {
+                int n1, n2, n3;
+                tri.Triangle(i).Get(n1, n2, n3);
+                if (reversed) {
+                    std::swap(n2, n3);
+                }
+
+                const std::array<uint32_t, 3> t{nodeIndices[n1 - 1], nodeIndices[n2 - 1], nodeIndices[n3 - 1]};
+                if (t[0] != t[1] && t[1] != t[2] && t[2] != t[0]) {
+                    triangles.push_back(t);
+                }
+            }
+        });
+
+        // Objects without triangles are not valid in 3MF
+        if (triangles.empty()) {
+            return;
+        }
+
+        const auto color = colorHex(shape);
+        const auto colorIt = std::find(colors.begin(), colors.end(), color);
+        if (colorIt != colors.end()) {
+            std::format_to(std::back_inserter(buf), "<object id=\"{}\" type=\"model\" pid=\"1\" pindex=\"{}\">\n", objectId, colorIt - colors.begin());
+        } else {
+            std::format_to(std::back_inserter(buf), "<object id=\"{}\" type=\"model\">\n", objectId);
+        }
+
+        buf += "<mesh>\n<vertices>\n";
+
+        for (const auto &p : welder.takePoints()) {
+            std::format_to(std::back_inserter(buf), "<vertex x=\"{}\" y=\"{}\" z=\"{}\"/>\n",
+                static_cast<float>(p.X()), static_cast<float>(p.Y()), static_cast<float>(p.Z()));
+        }
+
+        buf += "</vertices>\n<triangles>\n";
+
+        for (const auto &t : triangles) {
+            std::format_to(std::back_inserter(buf), "<triangle v1=\"{}\" v2=\"{}\" v3=\"{}\"/>\n", t[0], t[1], t[2]);
+        }
+
+        buf += "</triangles>\n</mesh>\n</object>\n";
+
+        zip.write(buf);
+        objectIds.push_back(objectId++);
+    });
+
+    if (!completed) {
+        return {false, "canceled"};
+    }
+
+    zip.write("</resources>\n<build>\n");
+    for (const auto id : objectIds) {
+        zip.write(std::format("<item objectid=\"{}\"/>\n", id));
+    }
+    zip.write("</build>\n</model>\n");
+    zip.endEntry();
+
+    if (!zip.finish()) {
+        return {false, "write failed"};
+    }
+
+    os.close();
+    if (!os) {
+        return {false, "write failed"};
+    }
+
+    return {true, {}};
+}
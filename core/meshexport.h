@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+#include "export.h"
+
+// Mesh formats. Shapes are meshed in parallel one batch at a time and their triangles are streamed to the file, so
+// memory use is bounded by the batch size rather than the size of the whole result.
+ExportResult exportStl(const std::string &path, const ShapeList &shapes, const ExportOptions &options, const Message_ProgressRange &progress);
+ExportResult export3mf(const std::string &path, const ShapeList &shapes, const ExportOptions &options, const Message_ProgressRange &progress);
@@ -0,0 +1,97 @@
+#include <cmath>
+
+#include <BRep_Tool.hxx>
+#include <BRepAdaptor_Surface.hxx>
+#include <BRepTools.hxx>
+#include <Precision.hxx>
+#include <TopExp_Explorer.hxx>
+#include <TopoDS.hxx>
+
+#include "shapehash.h"
+
+namespace
+{
+
+const int c_surfaceSamples = 3;
+const double c_quantum = 1e-6;
+
+void sampleFace(const TopoDS_Face &face, std::vector<gp_Pnt> &out) {
+    for (TopExp_Explorer ex(face, TopAbs_VERTEX); ex.More(); ex.Next()) {
+        out.push_back(BRep_Tool::Pnt(TopoDS::Vertex(ex.Current())));
+    }
+
+    double umin, umax, vmin, vmax;
+    BRepTools::UVBounds(face, umin, umax, vmin, vmax);
+    if (Precision::IsInfinite(umin) || Precision::IsInfinite(umax) || Precision::IsInfinite(vmin) || Precision::IsInfinite(vmax)) {
+        return;
+    }
+
+    BRepAdaptor_Surface surface(face, false);
+    for (int i = 0; i < c_surfaceSamples; i++) {
+        for (int j = 0; j < c_surfaceSamples; j++) {
+            const double u = umin + (umax - umin) * (i + 0.5) / c_surfaceSamples;
+            const double v = vmin + (vmax - vmin) * (j + 0.5) / c_surfaceSamples;
+            out.push_back(surface.Value(u, v));
+        }
+    }
+}
+
+size_t hashPoints(const std::vector<gp_Pnt> &points, size_t seed) {
+    size_t h = seed ^ points.size();
+    for (const auto &pt : points) {
+        for (int i = 1; i <= 3; i++) {
+            const auto q = static_cast<int64_t>(std::llround(pt.Coord(i) / c_quantum));
+            h ^= std::hash<int64_t>{}(q) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        }
+    }
+
+    return h;
+}
+
+}
+
+std::vector<gp_Pnt> sampleGeometry(const TopoDS_Shape &shape) {
+    std::vector<gp_Pnt> points;
+
+    const auto unlocated = shape.Located(TopLoc_Location{});
+    for (TopExp_Explorer ex(unlocated, TopAbs_FACE); ex.More(); ex.Next()) {
+        sampleFace(TopoDS::Face(ex.Current()), points);
+    }
+
+    // Wires, edges and vertices that are not part of a face
+    for (TopExp_Explorer ex(unlocated, TopAbs_VERTEX, TopAbs_FACE); ex.More(); ex.Next()) {
+        points.push_back(BRep_Tool::Pnt(TopoDS::Vertex(ex.Current())));
+    }
+
+    return points;
+}
+
+size_t geometryHash(const TopoDS_Shape &shape) {
+    return hashPoints(sampleGeometry(shape), static_cast<size_t>(shape.ShapeType()));
+}
+
+size_t faceGeometryHash(const TopoDS_Face &face) {
+    std::vector<gp_Pnt> points;
+    sampleFace(TopoDS::Face(face.Located(TopLoc_Location{})), points);
+    return hashPoints(points, static_cast<size_t>(face.Orientation()));
+}
+
+bool isSameGeometry(const TopoDS_Shape &a, const TopoDS_Shape &b) {
+    if (a.ShapeType() != b.ShapeType()) {
+        return false;
+    }
+
+    const auto pa = sampleGeometry(a);
+    const auto pb = sampleGeometry(b);
+    if (pa.size() != pb.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < pa.size(); i++) {
+        if (!pa[i].IsEqual(pb[i], Precision::Confusion())) {
+            return false;
+        }
+    }
+
+    return true;
+}
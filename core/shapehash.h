@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <gp_Pnt.hxx>
+#include <TopoDS_Face.hxx>
+#include <TopoDS_Shape.hxx>
+
+// Geometry fingerprints built from points sampled on face surfaces and vertices, so they do not depend on how a
+// shape was constructed. The shape's own location is ignored: the same geometry placed in two different places
+// hashes the same, which is what instancing needs.
+
+std::vector<gp_Pnt> sampleGeometry(const TopoDS_Shape &shape);
+size_t geometryHash(const TopoDS_Shape &shape);
+size_t faceGeometryHash(const TopoDS_Face &face);
+
+// Compares the sampled points of two shapes, to back up geometryHash, which can collide. Faces that agree at the
+// samples but differ elsewhere compare equal, so this is only good enough to reuse a presentation, not to substitute
+// one shape for another.
+bool isSameGeometry(const TopoDS_Shape &a, const TopoDS_Shape &b);
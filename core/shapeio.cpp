@@ -0,0 +1,244 @@
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+#include <BinTools.hxx>
+#include <BRep_Builder.hxx>
+#include <Standard_Failure.hxx>
+#include <TopoDS_Compound.hxx>
+#include <TopoDS_Iterator.hxx>
+
+#include "shapeio.h"
+
+namespace
+{
+
+const char c_magic[8] = {'P', 'C', 'S', 'H', 'A', 'P', 'E', 'S'};
+const uint32_t c_version = 2;
+
+// Sanity limit for lengths read from the stream, so that corrupted data does not cause huge allocations
+const uint32_t c_maxLength = 1 << 28;
+
+template <typename T>
+void writePod(std::ostream &os, T v) {
+    os.write(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+template <typename T>
+bool readPod(std::istream &is, T &v) {
+    return static_cast<bool>(is.read(reinterpret_cast<char *>(&v), sizeof(v)));
+}
+
+void writeString(std::ostream &os, const std::string &str) {
+    writePod<uint32_t>(os, str.size());
+    os.write(str.data(), str.size());
+}
+
+bool readString(std::istream &is, std::string &out) {
+    uint32_t size = 0;
+    if (!readPod(is, size) || size > c_maxLength) {
+        return false;
+    }
+
+    out.resize(size);
+    return static_cast<bool>(is.read(out.data(), size));
+}
+
+void writeValue(std::ostream &os, const Value &value) {
+    switch (value.type()) {
+        case Type::Boolean:
+            writePod<uint8_t>(os, static_cast<uint8_t>(Type::Boolean));
+            writePod<uint8_t>(os, value.as<bool>() ? 1 : 0);
+            break;
+        case Type::Number:
+            writePod<uint8_t>(os, static_cast<uint8_t>(Type::Number));
+            writePod<double>(os, value.as<double>());
+            break;
+        case Type::String:
+            writePod<uint8_t>(os, static_cast<uint8_t>(Type::String));
+            writeString(os, value.as<std::string>());
+            break;
+        case Type::ValueList: {
+            const auto &list = value.as<ValueList>();
+            writePod<uint8_t>(os, static_cast<uint8_t>(Type::ValueList));
+            writePod<uint32_t>(os, list.size());
+            for (const auto &item : list) {
+                writeValue(os, item);
+            }
+            break;
+        }
+        default:
+            writePod<uint8_t>(os, static_cast<uint8_t>(Type::Undefined));
+            break;
+    }
+}
+
+bool readValue(std::istream &is, Value &out) {
+    uint8_t type = 0;
+    if (!readPod(is, type)) {
+        return false;
+    }
+
+    switch (static_cast<Type>(type)) {
+        case Type::Undefined:
+            out = undefined;
+            return true;
+        case Type::Boolean: {
+            uint8_t b = 0;
+            if (!readPod(is, b)) {
+                return false;
+            }
+            out = Value{b != 0};
+            return true;
+        }
+        case Type::Number: {
+            double d = 0.0;
+            if (!readPod(is, d)) {
+                return false;
+            }
+            out = Value{d};
+            return true;
+        }
+        case Type::String: {
+            std::string str;
+            if (!readString(is, str)) {
+                return false;
+            }
+            out = Value{std::move(str)};
+            return true;
+        }
+        case Type::ValueList: {
+            uint32_t size = 0;
+            if (!readPod(is, size) || size > c_maxLength) {
+                return false;
+            }
+
+            ValueList list;
+            list.reserve(size);
+            for (uint32_t i = 0; i < size; i++) {
+                Value item;
+                if (!readValue(is, item)) {
+                    return false;
+                }
+                list.push_back(item);
+            }
+            out = Value{std::move(list)};
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+}
+
+void writeShapes(std::ostream &os, const ShapeList &shapes, const Message_ProgressRange &progress) {
+    os.write(c_magic, sizeof(c_magic));
+    writePod<uint32_t>(os, c_version);
+    writePod<uint32_t>(os, shapes.size());
+
+    BRep_Builder builder;
+    TopoDS_Compound compound;
+    builder.MakeCompound(compound);
+
+    for (const auto &sh : shapes) {
+        writePod<uint8_t>(os, sh.shape().IsNull() ? 0 : 1);
+        builder.Add(compound, sh.shape().IsNull() ? TopoDS_Compound{} : sh.shape());
+
+        writePod<uint32_t>(os, sh.props().size());
+        for (const auto &[name, value] : sh.props()) {
+            writeString(os, name);
+            writeValue(os, value);
+        }
+
+        writePod<uint32_t>(os, sh.spans().size());
+        for (const auto &span : sh.spans()) {
+            writePod<int32_t>(os, span.begin);
+            writePod<int32_t>(os, span.end);
+            writePod<int32_t>(os, span.line);
+            writePod<int32_t>(os, span.column);
+        }
+    }
+
+    BinTools::Write(compound, os, true, false, BinTools_FormatVersion_CURRENT, progress);
+}
+
+std::optional<ShapeList> readShapes(std::istream &is) {
+    char magic[sizeof(c_magic)];
+    uint32_t version = 0, count = 0;
+
+    if (!is.read(magic, sizeof(magic)) || std::memcmp(magic, c_magic, sizeof(magic)) != 0) {
+        return std::nullopt;
+    }
+
+    if (!readPod(is, version) || version != c_version || !readPod(is, count) || count > c_maxLength) {
+        return std::nullopt;
+    }
+
+    struct Entry {
+        bool isNull;
+        std::unordered_map<std::string, Value> props;
+        std::vector<Span> spans;
+    };
+
+    std::vector<Entry> entries(count);
+    for (auto &entry : entries) {
+        uint8_t notNull = 0;
+        uint32_t propCount = 0;
+        if (!readPod(is, notNull) || !readPod(is, propCount) || propCount > c_maxLength) {
+            return std::nullopt;
+        }
+
+        entry.isNull = !notNull;
+
+        for (uint32_t i = 0; i < propCount; i++) {
+            std::string name;
+            Value value;
+            if (!readString(is, name) || !readValue(is, value)) {
+                return std::nullopt;
+            }
+
+            entry.props.emplace(std::move(name), value);
+        }
+
+        uint32_t spanCount = 0;
+        if (!readPod(is, spanCount) || spanCount > c_maxLength) {
+            return std::nullopt;
+        }
+
+        entry.spans.resize(spanCount);
+        for (auto &span : entry.spans) {
+            int32_t fields[4];
+            if (!is.read(reinterpret_cast<char *>(fields), sizeof(fields))) {
+                return std::nullopt;
+            }
+
+            span = Span{fields[0], fields[1], fields[2], fields[3]};
+        }
+    }
+
+    TopoDS_Shape compound;
+    try {
+        BinTools::Read(compound, is);
+    } catch (Standard_Failure &) {
+        return std::nullopt;
+    }
+
+    if (compound.IsNull() || is.fail()) {
+        return std::nullopt;
+    }
+
+    ShapeList result;
+    result.reserve(count);
+
+    auto entry = entries.begin();
+    for (TopoDS_Iterator it(compound); it.More() && entry != entries.end(); it.Next(), entry++) {
+        result.push_back(Shape{entry->isNull ? TopoDS_Shape{} : it.Value(), entry->props, entry->spans});
+    }
+
+    if (result.size() != count) {
+        return std::nullopt;
+    }
+
+    return result;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <iosfwd>
+#include <optional>
+
+#include <Message_ProgressRange.hxx>
+
+#include "value.h"
+
+// Binary serialization for shape lists. Geometry is stored in OCCT's binary BRep format, and props and spans
+// alongside it.
+// Props that cannot be serialized (shapes and functions) are stored as undefined.
+void writeShapes(std::ostream &os, const ShapeList &shapes, const Message_ProgressRange &progress = {});
+std::optional<ShapeList> readShapes(std::istream &is);
@@ -0,0 +1,124 @@
+#include <IFSelect_ReturnStatus.hxx>
+#include <Quantity_Color.hxx>
+#include <STEPCAFControl_Reader.hxx>
+#include <TDataStd_Name.hxx>
+#include <TDF_LabelSequence.hxx>
+#include <TDocStd_Document.hxx>
+#include <XCAFDoc_ColorTool.hxx>
+#include <XCAFDoc_DocumentTool.hxx>
+#include <XCAFDoc_ShapeTool.hxx>
+
+#include "stepreader.h"
+#include "xdedocument.h"
+
+namespace
+{
+
+struct PartCollector {
+    Handle(XCAFDoc_ShapeTool) shapeTool;
+    Handle(XCAFDoc_ColorTool) colorTool;
+    ShapeList parts;
+
+    static std::string labelName(const TDF_Label &label) {
+        Handle(TDataStd_Name) name;
+        if (!label.FindAttribute(TDataStd_Name::GetID(), name)) {
+            return {};
+        }
+
+        return TCollection_AsciiString(name->Get()).ToCString();
+    }
+
+    std::string labelColor(const TDF_Label &label) const {
+        Quantity_Color color;
+        if (colorTool->GetColor(label, XCAFDoc_ColorSurf, color) || colorTool->GetColor(label, XCAFDoc_ColorGen, color)) {
+            return Quantity_Color::ColorToHex(color).ToCString();
+        }
+
+        return {};
+    }
+
+    void collect(const TDF_Label &label, const TopLoc_Location &parentLocation, const std::string &assembly, const std::string &parentColor) {
+        TDF_Label referred = label;
+        TopLoc_Location location = parentLocation;
+
+        if (XCAFDoc_ShapeTool::IsReference(label)) {
+            XCAFDoc_ShapeTool::GetReferredShape(label, referred);
+            location = parentLocation * XCAFDoc_ShapeTool::GetLocation(label);
+        }
+
+        // Instance attributes take precedence over the ones on the referred prototype
+        auto name = labelName(label);
+        if (name.empty()) {
+            name = labelName(referred);
+        }
+
+        auto color = labelColor(label);
+        if (color.empty()) {
+            color = labelColor(referred);
+        }
+        if (color.empty()) {
+            color = parentColor;
+        }
+
+        if (XCAFDoc_ShapeTool::IsAssembly(referred)) {
+            const auto childAssembly = assembly.empty() ? name : assembly + "/" + name;
+
+            TDF_LabelSequence components;
+            XCAFDoc_ShapeTool::GetComponents(referred, components);
+            for (const auto &component : components) {
+                collect(component, location, childAssembly, color);
+            }
+
+            return;
+        }
+
+        const auto shape = XCAFDoc_ShapeTool::GetShape(referred);
+        if (shape.IsNull()) {
+            return;
+        }
+
+        std::unordered_map<std::string, Value> props;
+        if (!name.empty()) {
+            props.emplace("name", name);
+        }
+        if (!color.empty()) {
+            props.emplace("color", color);
+        }
+        if (!assembly.empty()) {
+            props.emplace("assembly", assembly);
+        }
+
+        parts.push_back(Shape{shape.Moved(location), props, std::vector<Span>{}});
+    }
+};
+
+}
+
+StepResult readStep(const std::string &path) {
+    XdeDocument doc;
+
+    STEPCAFControl_Reader reader;
+    reader.SetColorMode(true);
+    reader.SetNameMode(true);
+
+    if (reader.ReadFile(path.c_str()) != IFSelect_RetDone) {
+        return {std::nullopt, "cannot parse STEP file"};
+    }
+
+    if (!reader.Transfer(doc.get())) {
+        return {std::nullopt, "cannot translate STEP file"};
+    }
+
+    PartCollector collector{
+        XCAFDoc_DocumentTool::ShapeTool(doc->Main()),
+        XCAFDoc_DocumentTool::ColorTool(doc->Main()),
+    };
+
+    TDF_LabelSequence roots;
+    collector.shapeTool->GetFreeShapes(roots);
+    for (const auto &root : roots) {
+        collector.collect(root, TopLoc_Location{}, {}, {});
+    }
+
+    return {std::move(collector.parts), {}};
+}
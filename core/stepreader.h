@@ -0,0 +1,15 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "value.h"
+
+struct StepResult {
+    std::optional<ShapeList> shapes;
+    std::string error;
+};
+
+// Reads a STEP file through an XDE document. Every part becomes one shape placed at its assembly location, with
+// "name", "color" and "assembly" (the path of parent assembly names) props where the file provides them.
+StepResult readStep(const std::string &path);
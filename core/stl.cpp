@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <BRep_Builder.hxx>
+#include <BRepLib.hxx>
+#include <Geom_Line.hxx>
+#include <Geom_Plane.hxx>
+#include <Precision.hxx>
+#include <TopoDS.hxx>
+#include <TopoDS_Edge.hxx>
+#include <TopoDS_Face.hxx>
+#include <TopoDS_Iterator.hxx>
+#include <TopoDS_Shell.hxx>
+#include <TopoDS_Solid.hxx>
+#include <TopoDS_Vertex.hxx>
+#include <TopoDS_Wire.hxx>
+
+#include "stl.h"
+#include "vertexwelder.h"
+
+namespace
+{
+
+using Triangle = std::array<uint32_t, 3>;
+
+struct Mesh {
+    std::vector<gp_Pnt> points;
+    std::vector<Triangle> triangles;
+};
+
+void addTriangle(VertexWelder &welder, Mesh &mesh, const gp_Pnt (&pts)[3]) {
+    Triangle tri{welder.add(pts[0]), welder.add(pts[1]), welder.add(pts[2])};
+
+    // Triangles that collapse when welded carry no area
+    if (tri[0] != tri[1] && tri[1] != tri[2] && tri[2] != tri[0]) {
+        mesh.triangles.push_back(tri);
+    }
+}
+
+float readFloat(const char *p) {
+    float f;
+    std::memcpy(&f, p, sizeof(f));
+    return f;
+}
+
+bool isBinaryStl(std::string_view data) {
+    if (data.size() < 84) {
+        return false;
+    }
+
+    uint32_t numTris = 0;
+    std::memcpy(&numTris, data.data() + 80, sizeof(numTris));
+
+    return 84 + static_cast<uint64_t>(numTris) * 50 == data.size();
+}
+
+void parseBinaryStl(std::string_view data, Mesh &mesh) {
+    uint32_t numTris = 0;
+    std::memcpy(&numTris, data.data() + 80, sizeof(numTris));
+
+    VertexWelder welder{Precision::Approximation()};
+    welder.reserve(numTris / 2 + 3);
+    mesh.triangles.reserve(numTris);
+
+    const char *p = data.data() + 84;
+    for (uint32_t i = 0; i < numTris; i++, p += 50) {
+        // 12 bytes normal, 3 x 12 bytes vertices, 2 bytes "attribute byte count"
+        gp_Pnt pts[3];
+        for (int j = 0; j < 3; j++) {
+            const char *v = p + 12 + j * 12;
+            pts[j].SetCoord(readFloat(v), readFloat(v + 4), readFloat(v + 8));
+        }
+
+        addTriangle(welder, mesh, pts);
+    }
+
+    mesh.points = welder.takePoints();
+}
+
+bool isAsciiStl(std::string_view data) {
+    const auto start = data.find_first_not_of(" \t\r\n");
+    return start != std::string_view::npos && data.substr(start).starts_with("solid");
+}
+
+bool parseAsciiStl(std::string_view data, Mesh &mesh, std::string &error) {
+    VertexWelder welder{Precision::Approximation()};
+
+    const char *p = data.data();
+    const char *end = data.data() + data.size();
+
+    const auto skipSpace = [&]() {
+        while (p < end && std::isspace(static_cast<unsigned char>(*p))) {
+            p++;
+        }
+    };
+
+    const auto token = [&]() {
+        skipSpace();
+        const char *start = p;
+        while (p < end && !std::isspace(static_cast<unsigned char>(*p))) {
+            p++;
+        }
+        return std::string_view{start, static_cast<size_t>(p - start)};
+    };
+
+    gp_Pnt pts[3];
+    int vertexCount = 0;
+
+    while (p < end) {
+        auto tok = token();
+        if (tok == "vertex") {
+            if (vertexCount == 3) {
+                error = "ASCII STL facet does not have exactly three vertices";
+                return false;
+            }
+
+            double coords[3];
+            for (double &coord : coords) {
+                skipSpace();
+                auto [ptr, ec] = std::from_chars(p, end, coord);
+                if (ec != std::errc{}) {
+                    error = "invalid vertex coordinate in ASCII STL";
+                    return false;
+                }
+                p = ptr;
+            }
+
+            pts[vertexCount++].SetCoord(coords[0], coords[1], coords[2]);
+        } else if (tok == "endloop") {
+            if (vertexCount != 3) {
+                error = "ASCII STL facet does not have exactly three vertices";
+                return false;
+            }
+
+            addTriangle(welder, mesh, pts);
+            vertexCount = 0;
+        }
+    }
+
+    mesh.points = welder.takePoints();
+    return true;
+}
+
+TopoDS_Edge makeEdge(const TopoDS_Vertex &v1, const gp_Pnt &p1, const TopoDS_Vertex &v2, const gp_Pnt &p2) {
+    BRep_Builder builder;
+
+    TopoDS_Edge edge;
+    builder.MakeEdge(edge, new Geom_Line(p1, gp_Dir{gp_Vec{p1, p2}}), Precision::Confusion());
+    builder.Add(edge, v1.Oriented(TopAbs_FORWARD));
+    builder.Add(edge, v2.Oriented(TopAbs_REVERSED));
+    builder.Range(edge, 0.0, p1.Distance(p2));
+
+    return edge;
+}
+
+TopoDS_Shape buildShape(const Mesh &mesh) {
+    BRep_Builder builder;
+
+    std::vector<TopoDS_Vertex> verts(mesh.points.size());
+    for (size_t i = 0; i < mesh.points.size(); i++) {
+        builder.MakeVertex(verts[i], mesh.points[i], Precision::Confusion());
+    }
+
+    struct EdgeEntry {
+        TopoDS_Edge edge;
+        uint32_t from;
+        int uses = 0;
+    };
+
+    std::unordered_map<uint64_t, EdgeEntry> edges;
+    edges.reserve(mesh.triangles.size() * 3 / 2 + 1);
+
+    const auto getEdge = [&](uint32_t a, uint32_t b) -> TopoDS_Edge {
+        const uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+
+        auto [it, inserted] = edges.try_emplace(key);
+        auto &entry = it->second;
+        if (inserted) {
+            entry.edge = makeEdge(verts[a], mesh.points[a], verts[b], mesh.points[b]);
+            entry.from = a;
+        }
+
+        entry.uses++;
+        return TopoDS::Edge(entry.from == a ? entry.edge.Oriented(TopAbs_FORWARD) : entry.edge.Oriented(TopAbs_REVERSED));
+    };
+
+    TopoDS_Shell shell;
+    builder.MakeShell(shell);
+
+    for (const auto &tri : mesh.triangles) {
+        const auto &p0 = mesh.points[tri[0]];
+        const auto &p1 = mesh.points[tri[1]];
+        const auto &p2 = mesh.points[tri[2]];
+
+        const auto normal = gp_Vec{p0, p1}.Crossed(gp_Vec{p0, p2});
+        if (normal.Magnitude() <= gp::Resolution()) {
+            continue;
+        }
+
+        TopoDS_Wire wire;
+        builder.MakeWire(wire);
+        builder.Add(wire, getEdge(tri[0], tri[1]));
+        builder.Add(wire, getEdge(tri[1], tri[2]));
+        builder.Add(wire, getEdge(tri[2], tri[0]));
+        wire.Closed(true);
+
+        TopoDS_Face face;
+        builder.MakeFace(face, new Geom_Plane(p0, gp_Dir{normal}), Precision::Confusion());
+        builder.Add(face, wire);
+
+        for (TopoDS_Iterator it(wire); it.More(); it.Next()) {
+            BRepLib::BuildPCurveForEdgeOnPlane(TopoDS::Edge(it.Value()), face);
+        }
+
+        builder.Add(shell, face);
+    }
+
+    const bool closed = !edges.empty() && std::all_of(edges.cbegin(), edges.cend(), [](const auto &e) { return e.second.uses == 2; });
+    if (!closed) {
+        return shell;
+    }
+
+    shell.Closed(true);
+
+    TopoDS_Solid solid;
+    builder.MakeSolid(solid);
+    builder.Add(solid, shell);
+
+    // Fixes inside-out meshes
+    BRepLib::OrientClosedSolid(solid);
+
+    return solid;
+}
+
+}
+
+StlResult readStl(std::string_view data) {
+    Mesh mesh;
+    std::string error;
+
+    if (isBinaryStl(data)) {
+        parseBinaryStl(data, mesh);
+    } else if (isAsciiStl(data)) {
+        if (!parseAsciiStl(data, mesh, error)) {
+            return {std::nullopt, error};
+        }
+    } else {
+        return {std::nullopt, "not a valid STL file"};
+    }
+
+    if (mesh.triangles.empty()) {
+        return {std::nullopt, "STL file contains no triangles"};
+    }
+
+    return {buildShape(mesh), {}};
+}
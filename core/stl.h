@@ -0,0 +1,16 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <TopoDS_Shape.hxx>
+
+struct StlResult {
+    std::optional<TopoDS_Shape> shape;
+    std::string error;
+};
+
+// Parses binary or ASCII STL data. Coincident vertices are welded and triangles that share a side share an edge,
+// so a closed mesh becomes a solid directly without sewing. Open meshes are returned as a shell.
+StlResult readStl(std::string_view data);
@@ -0,0 +1,35 @@
+// Build-time tool: converts the embedded pollo STL into a binary BRep so that it doesn't have to be
+// welded and built into a solid at runtime.
+
+#include <iostream>
+
+#include <BinTools.hxx>
+
+#include "mappedfile.h"
+#include "stl.h"
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " input.stl output.brep\n";
+        return 1;
+    }
+
+    MappedFile file{argv[1]};
+    if (!file.isOpen()) {
+        std::cerr << "cannot open " << argv[1] << ": " << file.error() << "\n";
+        return 1;
+    }
+
+    auto stl = readStl(file.data());
+    if (!stl.shape) {
+        std::cerr << "cannot read " << argv[1] << ": " << stl.error << "\n";
+        return 1;
+    }
+
+    if (!BinTools::Write(*stl.shape, argv[2])) {
+        std::cerr << "cannot write " << argv[2] << "\n";
+        return 1;
+    }
+
+    return 0;
+}
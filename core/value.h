@@ -36,6 +36,7 @@ public:
     const TopoDS_Shape &shape() const { return m_shape; }
     bool hasProp(const std::string &name) const;
     Value getProp(const std::string &name) const;
+    const std::unordered_map<std::string, Value> &props() const { return m_props; }
 
     const std::vector<Span> &spans() const { return m_spans; }
 
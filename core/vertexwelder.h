@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <gp_Pnt.hxx>
+
+// Welds vertices that are within tolerance of each other using a uniform grid. Each grid cell is as wide as the
+// tolerance, so only the 27 surrounding cells need to be searched for a match.
+class VertexWelder {
+public:
+    explicit VertexWelder(double tolerance) : m_tolerance(tolerance), m_invCellSize(1.0 / tolerance) { }
+
+    void reserve(size_t count) {
+        m_points.reserve(count);
+        m_next.reserve(count);
+        m_cells.reserve(count);
+    }
+
+    uint32_t add(const gp_Pnt &pt) {
+        const auto cell = cellOf(pt);
+
+        for (int64_t dx = -1; dx <= 1; dx++) {
+            for (int64_t dy = -1; dy <= 1; dy++) {
+                for (int64_t dz = -1; dz <= 1; dz++) {
+                    auto it = m_cells.find(CellKey{cell.x + dx, cell.y + dy, cell.z + dz});
+                    if (it == m_cells.end()) {
+                        continue;
+                    }
+
+                    for (uint32_t index = it->second; index != c_noIndex; index = m_next[index]) {
+                        if (m_points[index].IsEqual(pt, m_tolerance)) {
+                            return index;
+                        }
+                    }
+                }
+            }
+        }
+
+        const auto index = static_cast<uint32_t>(m_points.size());
+        m_points.push_back(pt);
+
+        auto [it, inserted] = m_cells.try_emplace(cell, index);
+        m_next.push_back(inserted ? c_noIndex : it->second);
+        it->second = index;
+
+        return index;
+    }
+
+    std::vector<gp_Pnt> takePoints() { return std::move(m_points); }
+
+private:
+    static constexpr const uint32_t c_noIndex = UINT32_MAX;
+
+    struct CellKey {
+        int64_t x, y, z;
+
+        bool operator==(const CellKey &) const = default;
+    };
+
+    struct CellKeyHash {
+        size_t operator()(const CellKey &k) const {
+            uint64_t h = static_cast<uint64_t>(k.x) * 0x9e3779b97f4a7c15ull;
+            h ^= static_cast<uint64_t>(k.y) * 0xc2b2ae3d27d4eb4full + (h << 6) + (h >> 2);
+            h ^= static_cast<uint64_t>(k.z) * 0x165667b19e3779f9ull + (h << 6) + (h >> 2);
+            return static_cast<size_t>(h);
+        }
+    };
+
+    CellKey cellOf(const gp_Pnt &pt) const {
+        return CellKey{
+            static_cast<int64_t>(std::floor(pt.X() * m_invCellSize)),
+            static_cast<int64_t>(std::floor(pt.Y() * m_invCellSize)),
+            static_cast<int64_t>(std::floor(pt.Z() * m_invCellSize)),
+        };
+    }
+
+    double m_tolerance;
+    double m_invCellSize;
+    std::vector<gp_Pnt> m_points;
+    std::vector<uint32_t> m_next; // chains vertices that fall in the same cell
+    std::unordered_map<CellKey, uint32_t, CellKeyHash> m_cells;
+};
@@ -0,0 +1,22 @@
+#include <mutex>
+
+#include <XCAFApp_Application.hxx>
+
+#include "xdedocument.h"
+
+namespace
+{
+
+std::mutex s_applicationLock;
+
+}
+
+XdeDocument::XdeDocument() {
+    std::unique_lock lock(s_applicationLock);
+    XCAFApp_Application::GetApplication()->NewDocument("MDTV-XCAF", m_doc);
+}
+
+XdeDocument::~XdeDocument() {
+    std::unique_lock lock(s_applicationLock);
+    XCAFApp_Application::GetApplication()->Close(m_doc);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <TDocStd_Document.hxx>
+
+// A document of the shared XDE application, closed when this goes out of scope. The application keeps a list of its
+// documents that is not thread-safe, so creating and closing documents is serialized between readers and writers on
+// different threads.
+class XdeDocument {
+public:
+    XdeDocument();
+    ~XdeDocument();
+
+    XdeDocument(const XdeDocument &) = delete;
+    XdeDocument &operator=(const XdeDocument &) = delete;
+
+    const Handle(TDocStd_Document) &get() const { return m_doc; }
+    const Handle(TDocStd_Document) &operator->() const { return m_doc; }
+
+private:
+    Handle(TDocStd_Document) m_doc;
+};
@@ -0,0 +1,141 @@
+#include <array>
+#include <ostream>
+
+#include "zipwriter.h"
+
+namespace
+{
+
+const uint16_t c_version = 20;
+const uint16_t c_flagDataDescriptor = 0x0008;
+const uint16_t c_methodStore = 0;
+const uint16_t c_dosTime = 0;
+const uint16_t c_dosDate = (1 << 5) | 1; // 1980-01-01
+
+const std::array<uint32_t, 256> c_crcTable = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+        }
+        table[i] = c;
+    }
+    return table;
+}();
+
+uint32_t updateCrc(uint32_t crc, const char *data, size_t size) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = c_crcTable[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+}
+
+void ZipWriter::beginEntry(const std::string &name) {
+    if (m_offset > UINT32_MAX) {
+        m_overflow = true;
+    }
+
+    m_entries.push_back(Entry{name, 0, 0, static_cast<uint32_t>(m_offset)});
+    m_entrySize = 0;
+    m_crc = 0;
+
+    write32(0x04034b50);
+    write16(c_version);
+    write16(c_flagDataDescriptor);
+    write16(c_methodStore);
+    write16(c_dosTime);
+    write16(c_dosDate);
+    write32(0); // crc, size and compressed size follow in the data descriptor
+    write32(0);
+    write32(0);
+    write16(name.size());
+    write16(0);
+    writeRaw(name.data(), name.size());
+}
+
+void ZipWriter::write(const char *data, size_t size) {
+    m_crc = updateCrc(m_crc, data, size);
+    m_entrySize += size;
+    writeRaw(data, size);
+}
+
+void ZipWriter::endEntry() {
+    if (m_entrySize > UINT32_MAX) {
+        m_overflow = true;
+    }
+
+    auto &entry = m_entries.back();
+    entry.crc = m_crc;
+    entry.size = static_cast<uint32_t>(m_entrySize);
+
+    write32(0x08074b50);
+    write32(entry.crc);
+    write32(entry.size);
+    write32(entry.size);
+}
+
+bool ZipWriter::finish() {
+    const uint64_t directoryOffset = m_offset;
+
+    for (const auto &entry : m_entries) {
+        write32(0x02014b50);
+        write16(c_version);
+        write16(c_version);
+        write16(c_flagDataDescriptor);
+        write16(c_methodStore);
+        write16(c_dosTime);
+        write16(c_dosDate);
+        write32(entry.crc);
+        write32(entry.size);
+        write32(entry.size);
+        write16(entry.name.size());
+        write16(0); // extra field length
+        write16(0); // comment length
+        write16(0); // disk number
+        write16(0); // internal attributes
+        write32(0); // external attributes
+        write32(entry.offset);
+        writeRaw(entry.name.data(), entry.name.size());
+    }
+
+    const uint64_t directorySize = m_offset - directoryOffset;
+    if (directoryOffset > UINT32_MAX || m_entries.size() > UINT16_MAX) {
+        m_overflow = true;
+    }
+
+    write32(0x06054b50);
+    write16(0);
+    write16(0);
+    write16(m_entries.size());
+    write16(m_entries.size());
+    write32(static_cast<uint32_t>(directorySize));
+    write32(static_cast<uint32_t>(directoryOffset));
+    write16(0);
+
+    m_os.flush();
+    return m_os.good() && !m_overflow;
+}
+
+void ZipWriter::writeRaw(const void *data, size_t size) {
+    m_os.write(static_cast<const char *>(data), size);
+    m_offset += size;
+}
+
+void ZipWriter::write16(uint16_t v) {
+    const char bytes[2] = {static_cast<char>(v & 0xff), static_cast<char>(v >> 8)};
+    writeRaw(bytes, sizeof(bytes));
+}
+
+void ZipWriter::write32(uint32_t v) {
+    const char bytes[4] = {
+        static_cast<char>(v & 0xff),
+        static_cast<char>((v >> 8) & 0xff),
+        static_cast<char>((v >> 16) & 0xff),
+        static_cast<char>(v >> 24),
+    };
+    writeRaw(bytes, sizeof(bytes));
+}
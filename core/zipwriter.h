@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Minimal streaming ZIP writer. Entries are stored uncompressed and their sizes and checksums are written after the
+// data, so entries can be written incrementally without buffering them. Does not support ZIP64 (4 GB limit).
+class ZipWriter {
+public:
+    explicit ZipWriter(std::ostream &os) : m_os(os) { }
+
+    void beginEntry(const std::string &name);
+    void write(const char *data, size_t size);
+    void write(const std::string &data) { write(data.data(), data.size()); }
+    void endEntry();
+
+    // Writes the central directory. Returns false if the stream failed or the archive became too large.
+    bool finish();
+
+private:
+    struct Entry {
+        std::string name;
+        uint32_t crc;
+        uint32_t size;
+        uint32_t offset;
+    };
+
+    std::ostream &m_os;
+    std::vector<Entry> m_entries;
+    uint64_t m_offset = 0;
+    uint64_t m_entrySize = 0;
+    uint32_t m_crc = 0;
+    bool m_overflow = false;
+
+    void writeRaw(const void *data, size_t size);
+    void write16(uint16_t v);
+    void write32(uint32_t v);
+};
@@ -7,6 +7,8 @@ Item {
     property alias cursorPosition: code.cursorPosition
     property alias highlightedSpans: decorator.highlightedSpans
     property int hoveredPosition: -1
+    // Delay after the last edit before codeChanged is emitted.
+    property int typingDelay: 1000
     property int lineNumberWidth: hiddenLineNumber.width * Math.max(Math.ceil(Math.log(code.lineCount + 1) / Math.LN10), 4)
 
     property string prevText: ""
@@ -177,7 +179,7 @@ Item {
 
     Timer {
         id: typingTimeout
-        interval: 1000
+        interval: root.typingDelay
         onTriggered: codeChanged();
     }
 }
@@ -6,6 +6,7 @@ import pollocadgui
 
 ApplicationWindow {
     property bool shapeOutOfDate: false
+    property var lastResult: null
 
     id: window
     width: 1800
@@ -50,6 +51,7 @@ ApplicationWindow {
             SplitView.preferredWidth: 600
 
             highlightedSpans: occtView.hoveredSpans
+            typingDelay: executor.typingDelay
 
             onCodeChanged: {
                 executor.execute(code.text);
@@ -127,6 +129,41 @@ ApplicationWindow {
                             occtView.showHighlightedShapes = checked;
                         }
                     }
+
+                    ProgressBar {
+                        visible: executor.isBusy
+                        value: executor.progress
+                    }
+
+                    Label {
+                        visible: lastResult !== null && lastResult.hasShapes
+                        text: lastResult ? "Meshes: " + (lastResult.memoryUsage / (1024 * 1024)).toFixed(1) + " MB" : ""
+                    }
+
+                    Label {
+                        visible: lastResult !== null && lastResult.isPreview
+                        text: "Preview"
+                        color: "#a60"
+                    }
+
+                    Item {
+                        Layout.fillWidth: true
+                    }
+
+                    Label {
+                        text: exporter.status + (exporter.queuedCount > 0 ? " (" + exporter.queuedCount + " queued)" : "")
+                    }
+
+                    ProgressBar {
+                        visible: exporter.isBusy
+                        value: exporter.progress
+                    }
+
+                    Button {
+                        text: "Cancel export"
+                        visible: exporter.isBusy
+                        onClicked: exporter.cancel();
+                    }
                 }
 
                 Rectangle {
@@ -146,6 +183,7 @@ ApplicationWindow {
 
                     ListView {
                         id: messages
+                        model: executor.messages
                         clip: true
                         spacing: 2
 
@@ -206,9 +244,9 @@ ApplicationWindow {
     FileDialog {
         id: exportDialog
         fileMode: FileDialog.SaveFile
-        nameFilters: ["STEP file (*.step)"]
+        nameFilters: ["STEP file (*.step)", "STL file (*.stl)", "3MF file (*.3mf)", "pollocad BRep (*.pcbrep)"]
         defaultSuffix: ".step"
-        onAccepted: occtView.exportResult(selectedFile);
+        onAccepted: exporter.exportResult(lastResult, selectedFile);
     }
 
     Component.onCompleted: {
@@ -234,9 +272,18 @@ ApplicationWindow {
         function onResult(res) {
             occtView.setResult(res);
             code.setResult(res);
-            messages.model = res.messagesModel();
+            lastResult = res;
             shapeOutOfDate = !res.hasShapes;
         }
+
+        function onPartialResult(res) {
+            occtView.setResult(res);
+        }
+
+        function onProxyResult(res) {
+            occtView.setResult(res);
+            code.setResult(res);
+        }
     }
 
     Shortcut {
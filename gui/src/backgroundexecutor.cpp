@@ -1,45 +1,448 @@
+#include <algorithm>
 #include <format>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <QElapsedTimer>
+
+#include <BRep_Builder.hxx>
+#include <BRep_Tool.hxx>
+#include <OSD_Parallel.hxx>
+#include <Poly_Triangulation.hxx>
+#include <Prs3d_Drawer.hxx>
+#include <StdPrs_ToolTriangulatedShape.hxx>
+#include <TopExp_Explorer.hxx>
+#include <TopoDS.hxx>
+#include <TopoDS_Compound.hxx>
 
 #include "backgroundexecutor.h"
+#include "meshcache.h"
+
+namespace {
+
+constexpr int c_minTypingDelay = 100;
+constexpr int c_maxTypingDelay = 1000;
+// Weight of the latest run in the average run time.
+constexpr double c_runTimeSmoothing = 0.3;
+// Minimum time between partial results of a run, in milliseconds. Runs faster than this only show their final result.
+constexpr qint64 c_partialResultInterval = 250;
+// How long the editor has to be idle before a preview is replaced by a full run, in milliseconds
+constexpr int c_idleDelay = 1500;
+
+// Preview meshes are this much coarser than what AIS would use, so that results show up quickly. The viewer refines
+// them in the background.
+const double c_previewDeflectionFactor = 8.0;
+const double c_previewAngleFactor = 2.0;
+
+// Splits the shapes into groups that can be meshed in parallel. Meshing writes into the TFaces and TEdges, so copies
+// made by move or rot, which share their TShape, are meshed once, and shapes that share faces or edges, such as a
+// boolean result and its operands, are meshed together.
+std::vector<std::vector<TopoDS_Shape>> meshGroups(const ShapeList &shapes) {
+    std::vector<TopoDS_Shape> unique;
+    std::unordered_set<const TopoDS_TShape *> seen;
+    for (const auto &sh : shapes) {
+        if (!sh.shape().IsNull() && seen.insert(sh.shape().TShape().get()).second) {
+            unique.push_back(sh.shape().Located(TopLoc_Location{}));
+        }
+    }
+
+    std::vector<size_t> parent(unique.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    const auto root = [&](size_t i) {
+        while (parent[i] != i) {
+            i = parent[i] = parent[parent[i]];
+        }
+        return i;
+    };
+
+    std::unordered_map<const TopoDS_TShape *, size_t> owners;
+    for (size_t i = 0; i < unique.size(); i++) {
+        for (const auto type : {TopAbs_FACE, TopAbs_EDGE}) {
+            for (TopExp_Explorer ex(unique[i], type); ex.More(); ex.Next()) {
+                auto [it, inserted] = owners.try_emplace(ex.Current().TShape().get(), i);
+                if (!inserted) {
+                    parent[root(i)] = root(it->second);
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<TopoDS_Shape>> groups;
+    std::unordered_map<size_t, size_t> groupOf;
+    for (size_t i = 0; i < unique.size(); i++) {
+        auto [it, inserted] = groupOf.try_emplace(root(i), groups.size());
+        if (inserted) {
+            groups.emplace_back();
+        }
+        groups[it->second].push_back(unique[i]);
+    }
+
+    return groups;
+}
+
+// Triangulates the shapes with a coarse preview deflection, so that the renderer finds them already tessellated and
+// only has to upload the triangles. Faces that are unchanged since earlier runs come from the mesh cache.
+void meshForDisplay(const ShapeList &shapes) {
+    const auto groups = meshGroups(shapes);
+
+    OSD_Parallel::For(0, static_cast<int>(groups.size()), [&](int i) {
+        Handle(Prs3d_Drawer) drawer = new Prs3d_Drawer;
+
+        // The finest deflection of the group, which is what meshing each shape on its own would have given
+        double deflection = std::numeric_limits<double>::max();
+        BRep_Builder builder;
+        TopoDS_Compound compound;
+        builder.MakeCompound(compound);
+        for (const auto &shape : groups[i]) {
+            deflection = std::min(deflection, StdPrs_ToolTriangulatedShape::GetDeflection(shape, drawer));
+            builder.Add(compound, shape);
+        }
+
+        const auto &shape = groups[i].size() == 1 ? groups[i].front() : compound;
+        meshWithCache(shape, deflection * c_previewDeflectionFactor, drawer->DeviationAngle() * c_previewAngleFactor);
+    });
+}
+
+// Counts each triangulation once, however many shapes or locations share it
+qint64 meshMemoryUsage(const ShapeList &shapes) {
+    std::unordered_set<const Poly_Triangulation *> seen;
+    qint64 bytes = 0;
+
+    for (const auto &sh : shapes) {
+        for (TopExp_Explorer ex(sh.shape(), TopAbs_FACE); ex.More(); ex.Next()) {
+            TopLoc_Location location;
+            const auto &triangulation = BRep_Tool::Triangulation(TopoDS::Face(ex.Current()), location);
+            if (!triangulation || !seen.insert(triangulation.get()).second) {
+                continue;
+            }
+
+            qint64 perNode = sizeof(gp_Pnt);
+            if (triangulation->HasNormals()) {
+                perNode += 3 * sizeof(float);
+            }
+            if (triangulation->HasUVNodes()) {
+                perNode += sizeof(gp_Pnt2d);
+            }
+
+            bytes += triangulation->NbNodes() * perNode + triangulation->NbTriangles() * sizeof(Poly_Triangle);
+        }
+    }
+
+    return bytes;
+}
 
+BackgroundExecutorResult *makePartialResult(const ShapeList &shapes) {
+    auto copy = std::make_shared<const ShapeList>(shapes);
+    meshForDisplay(*copy);
+    return new BackgroundExecutorResult{{}, copy, meshMemoryUsage(*copy), BackgroundExecutorResult::Kind::Partial};
+}
+
+// Proxy shapes are drawn as wireframe placeholders, so they are not meshed
+BackgroundExecutorResult *makeProxyResult(const ExecutorResult &r) {
+    std::shared_ptr<const ShapeList> shapes;
+    if (r.result && r.result->is<ShapeList>()) {
+        auto value = std::make_shared<const Value>(*r.result);
+        shapes = std::shared_ptr<const ShapeList>(value, &value->as<ShapeList>());
+    }
+
+    return new BackgroundExecutorResult{r.messages, std::move(shapes), 0, BackgroundExecutorResult::Kind::Proxy};
+}
+
+BackgroundExecutorResult *makeResult(ExecutorResult r, Fidelity fidelity) {
+    if (!r.result) {
+        return new BackgroundExecutorResult{std::move(r.messages), nullptr, 0};
+    }
+
+    std::shared_ptr<const ShapeList> shapes;
+    qint64 memoryUsage = 0;
+
+    if (r.result->is<ShapeList>()) {
+        // Values are immutable, so the result keeps a reference to the value and points into it
+        auto value = std::make_shared<const Value>(*r.result);
+        shapes = std::shared_ptr<const ShapeList>(value, &value->as<ShapeList>());
+        meshForDisplay(*shapes);
+        memoryUsage = meshMemoryUsage(*shapes);
+    } else if (!*r.result) {
+        shapes = std::make_shared<const ShapeList>();
+    } else {
+        r.messages.push_back(LogMessage{LogMessage::Level::Error, "Top level value is not shapes"});
+    }
+
+    const bool isPreview = fidelity == Fidelity::Preview && r.simplified;
+    return new BackgroundExecutorResult{std::move(r.messages), std::move(shapes), memoryUsage,
+                                        BackgroundExecutorResult::Kind::Final, isPreview};
+}
+
+bool isSameMessage(const LogMessage &a, const LogMessage &b) {
+    return a.level == b.level && a.message == b.message && a.span.begin == b.span.begin && a.span.end == b.span.end
+        && a.span.line == b.span.line && a.span.column == b.span.column;
+}
+
+}
+
+BackgroundExecutor::BackgroundExecutor() {
+    m_threadPool.setMaxThreadCount(1);
+
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(c_idleDelay);
+    connect(&m_idleTimer, &QTimer::timeout, this, &BackgroundExecutor::runFullIfIdle);
+
+    connect(this, &BackgroundExecutor::result, &m_messages, [this](BackgroundExecutorResult *r) {
+        m_messages.setMessages(r->messages());
+    });
+    connect(this, &BackgroundExecutor::proxyResult, &m_messages, [this](BackgroundExecutorResult *r) {
+        m_messages.setMessages(r->messages());
+    });
+}
+
+BackgroundExecutor::~BackgroundExecutor() {
+    m_pending.reset();
+    cancelRuns();
+    m_threadPool.waitForDone();
+}
+
+// Edits are evaluated at preview fidelity. Once the editor has been idle for a while, a preview that left out work
+// is replaced by a full run.
 void BackgroundExecutor::execute(QString code) {
-    m_threadPool.start([this, code]() {
-        auto r = m_executor.execute(code.toStdString());
-        if (!r.result) {
-            emit result(new BackgroundExecutorResult{r.messages, {}});
-            emit isBusyChanged();
-            return;
+    m_code = code;
+    m_idleTimer.start();
+    request(code, Fidelity::Preview);
+}
+
+void BackgroundExecutor::request(QString code, Fidelity fidelity) {
+    if (m_running) {
+        m_pending = Request{code, fidelity};
+        cancelRuns();
+        return;
+    }
+
+    start(code, fidelity);
+}
+
+void BackgroundExecutor::cancelRuns() {
+    if (m_run) {
+        m_run->cancel();
+    }
+    if (m_proxyRun) {
+        m_proxyRun->cancel();
+    }
+}
+
+// Called when the editor has been idle and when a run finishes. With nothing running or pending, the published
+// result is that of the latest code.
+void BackgroundExecutor::runFullIfIdle() {
+    if (!m_idleTimer.isActive() && !m_running && m_result && m_result->isPreview()) {
+        request(m_code, Fidelity::Full);
+    }
+}
+
+void BackgroundExecutor::start(QString code, Fidelity fidelity) {
+    m_running = true;
+
+    setProgress(0.0);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // The callbacks run on the thread of the run
+    auto partialTimer = std::make_shared<QElapsedTimer>();
+    partialTimer->start();
+    auto shownPercent = std::make_shared<int>(0);
+
+    ExecutorCallbacks callbacks;
+
+    // Full runs follow a complete preview of the same code, which stays on screen until the final result. Partial
+    // results would replace it with fewer shapes.
+    if (fidelity != Fidelity::Full) {
+        callbacks.onPartialResult = [this, partialTimer](const ShapeList &shapes) {
+            if (partialTimer->elapsed() < c_partialResultInterval) {
+                return;
+            }
+
+            auto res = makePartialResult(shapes);
+            res->moveToThread(thread());
+            QMetaObject::invokeMethod(this, [this, res] { publishPartial(res); }, Qt::QueuedConnection);
+
+            // Meshing the partial result does not count towards the interval
+            partialTimer->restart();
+        };
+    }
+
+    callbacks.onProgress = [this, shownPercent](size_t finished, size_t total) {
+        const int percent = static_cast<int>(finished * 100 / total);
+        if (percent != *shownPercent) {
+            *shownPercent = percent;
+            QMetaObject::invokeMethod(this, [this, percent] { setProgress(percent / 100.0); }, Qt::QueuedConnection);
+        }
+    };
+
+    // The proxy run gets diagnostics and placeholders on screen while the run is busy with the geometry. Full runs
+    // follow a preview of the same code, which has already done that.
+    m_proxyRun = fidelity == Fidelity::Preview ? m_executor.start(code.toStdString(), {}, Fidelity::Proxy) : nullptr;
+    m_run = m_executor.start(code.toStdString(), std::move(callbacks), fidelity);
+
+    // Waits for the runs and meshes the result on the pool thread
+    m_threadPool.start([this, run = m_run, proxyRun = m_proxyRun, fidelity, timer]() {
+        if (proxyRun) {
+            const auto &proxy = proxyRun->result();
+            if (!proxy.canceled && !run->isFinished()) {
+                auto res = makeProxyResult(proxy);
+                res->moveToThread(thread());
+                QMetaObject::invokeMethod(this, [this, res] { publishProxy(res); }, Qt::QueuedConnection);
+            }
         }
 
-        std::optional<ShapeList> shapes;
-        
-        if (r.result->is<ShapeList>()) {
-            shapes = r.result->as<ShapeList>();
-        } else if (!*r.result) {
-            shapes = ShapeList{};
-        } else {
-            r.messages.push_back(LogMessage{LogMessage::Level::Error, "Top level value is not shapes"});
+        auto r = run->result();
+        const bool canceled = r.canceled;
+
+        // A canceled run has been superseded by a pending request, so its partial result is of no use.
+        if (!canceled) {
+            auto res = makeResult(std::move(r), fidelity);
+            res->moveToThread(thread());
+            QMetaObject::invokeMethod(this, [this, res] { publish(res); }, Qt::QueuedConnection);
         }
 
-        emit result(new BackgroundExecutorResult{r.messages, shapes});
-        emit isBusyChanged();
+        const auto elapsedMs = timer.elapsed();
+
+        QMetaObject::invokeMethod(this, [this, fidelity, canceled, elapsedMs] { finished(fidelity, canceled, elapsedMs); },
+                                  Qt::QueuedConnection);
     });
 
     emit isBusyChanged();
 }
 
+void BackgroundExecutor::publish(BackgroundExecutorResult *r) {
+    r->setParent(this);
+
+    // Users of the previous result keep its shapes alive for as long as they need them
+    if (m_result) {
+        m_result->deleteLater();
+    }
+
+    m_result = r;
+
+    if (m_partialResult) {
+        m_partialResult->deleteLater();
+        m_partialResult = nullptr;
+    }
+
+    if (m_proxyResult) {
+        m_proxyResult->deleteLater();
+        m_proxyResult = nullptr;
+    }
+
+    emit result(r);
+}
+
+void BackgroundExecutor::publishProxy(BackgroundExecutorResult *r) {
+    r->setParent(this);
+
+    if (m_proxyResult) {
+        m_proxyResult->deleteLater();
+    }
+
+    m_proxyResult = r;
+    emit proxyResult(r);
+}
+
+void BackgroundExecutor::publishPartial(BackgroundExecutorResult *r) {
+    r->setParent(this);
+
+    if (m_partialResult) {
+        m_partialResult->deleteLater();
+    }
+
+    m_partialResult = r;
+    emit partialResult(r);
+}
+
+void BackgroundExecutor::setProgress(double progress) {
+    if (progress != m_progress) {
+        m_progress = progress;
+        emit progressChanged();
+    }
+}
+
+void BackgroundExecutor::finished(Fidelity fidelity, bool canceled, qint64 elapsedMs) {
+    m_running = false;
+
+    // Canceled runs stopped early and say nothing about the cost of the script. Full runs only happen when idle, so
+    // the typing delay follows previews.
+    if (!canceled && fidelity == Fidelity::Preview) {
+        const int previousDelay = typingDelay();
+
+        m_averageRunTime = m_averageRunTime == 0.0
+            ? elapsedMs
+            : c_runTimeSmoothing * elapsedMs + (1.0 - c_runTimeSmoothing) * m_averageRunTime;
+
+        if (typingDelay() != previousDelay) {
+            emit typingDelayChanged();
+        }
+    }
+
+    if (m_pending) {
+        auto pending = std::move(*m_pending);
+        m_pending.reset();
+        start(pending.code, pending.fidelity);
+        return;
+    }
+
+    emit isBusyChanged();
+
+    runFullIfIdle();
+}
+
 bool BackgroundExecutor::isBusy() const {
-    return m_executor.isBusy();
+    return m_running;
 }
 
-const LogMessageModel *BackgroundExecutorResult::messagesModel() const {
-    return new LogMessageModel(m_messages);
+int BackgroundExecutor::typingDelay() const {
+    if (m_averageRunTime == 0.0) {
+        return c_maxTypingDelay;
+    }
+
+    return std::clamp(static_cast<int>(m_averageRunTime), c_minTypingDelay, c_maxTypingDelay);
 }
 
-LogMessageModel::LogMessageModel(std::vector<LogMessage> messages) : m_messages(messages) { }
+// Rows in the common prefix and suffix of the old and new messages are kept, and only the rows between them are
+// replaced. Edits that don't change what a script prints leave the panel untouched. Runs already limit their messages
+// to c_maxMessages, so all of them are shown.
+void LogMessageModel::setMessages(const std::vector<LogMessage> &messages) {
+    size_t prefix = 0;
+    while (prefix < m_rows.size() && prefix < messages.size() && isSameMessage(m_rows[prefix].message, messages[prefix])) {
+        prefix++;
+    }
+
+    size_t suffix = 0;
+    while (suffix < m_rows.size() - prefix && suffix < messages.size() - prefix
+           && isSameMessage(m_rows[m_rows.size() - 1 - suffix].message, messages[messages.size() - 1 - suffix])) {
+        suffix++;
+    }
+
+    const auto removeEnd = m_rows.size() - suffix;
+    if (removeEnd > prefix) {
+        beginRemoveRows({}, prefix, removeEnd - 1);
+        m_rows.erase(m_rows.begin() + prefix, m_rows.begin() + removeEnd);
+        endRemoveRows();
+    }
+
+    const auto insertEnd = messages.size() - suffix;
+    if (insertEnd > prefix) {
+        beginInsertRows({}, prefix, insertEnd - 1);
+        std::vector<Row> rows;
+        rows.reserve(insertEnd - prefix);
+        for (size_t i = prefix; i < insertEnd; i++) {
+            rows.push_back(Row{messages[i]});
+        }
+        m_rows.insert(m_rows.begin() + prefix, std::make_move_iterator(rows.begin()), std::make_move_iterator(rows.end()));
+        endInsertRows();
+    }
+}
 
 int LogMessageModel::rowCount(const QModelIndex &) const {
-    return m_messages.size();
+    return m_rows.size();
 }
 
 int LogMessageModel::columnCount(const QModelIndex &) const {
@@ -47,7 +450,8 @@ int LogMessageModel::columnCount(const QModelIndex &) const {
 }
 
 QVariant LogMessageModel::data(const QModelIndex &index, int role) const {
-    const auto &msg = m_messages[index.row()];
+    const auto &row = m_rows[index.row()];
+    const auto &msg = row.message;
 
     switch (role) {
     case Level:
@@ -57,11 +461,15 @@ QVariant LogMessageModel::data(const QModelIndex &index, int role) const {
             case LogMessage::Level::Error: default: return "error";
         }
     case Message: {
-        if (msg.message.find('|') != std::string::npos) {
-            return QString::fromStdString(msg.message);
-        } else {
-            return QString::fromStdString(std::format("{}:{}: {}", msg.span.line, msg.span.column, msg.message));
+        if (row.text.isNull()) {
+            if (msg.span.isEmpty() || msg.message.find('|') != std::string::npos) {
+                row.text = QString::fromStdString(msg.message);
+            } else {
+                row.text = QString::fromStdString(std::format("{}:{}: {}", msg.span.line, msg.span.column, msg.message));
+            }
         }
+
+        return row.text;
     }
     case Location:
         return msg.span.begin;
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <memory>
+
 #include <QAbstractListModel>
 #include <QFutureWatcher>
 #include <QObject>
 #include <QThreadPool>
+#include <QTimer>
 
 #include "executor.h"
 #include "value.h"
@@ -11,25 +14,8 @@
 
 class BackgroundExecutorResult;
 
-class BackgroundExecutor : public QObject
-{
-    Q_OBJECT
-
-    Q_PROPERTY(bool isBusy READ isBusy NOTIFY isBusyChanged);
-
-public:
-    Q_INVOKABLE void execute(QString code);
-    bool isBusy() const;
-
-signals:
-    void result(BackgroundExecutorResult *result);
-    void isBusyChanged();
-
-private:
-    Executor m_executor;
-    QThreadPool m_threadPool;
-};
-
+// Messages of the latest result. The model lives as long as the executor and is updated by row-level diffs between
+// runs, so that views keep their state and only changed rows are rebuilt. Rows are formatted when first shown.
 class LogMessageModel : public QAbstractListModel {
     Q_OBJECT
 
@@ -40,7 +26,7 @@ public:
         Location = 3,
     };
 
-    explicit LogMessageModel(std::vector<LogMessage> messages);
+    void setMessages(const std::vector<LogMessage> &messages);
 
     int rowCount(const QModelIndex & = QModelIndex()) const override;
     int columnCount(const QModelIndex & = QModelIndex()) const override;
@@ -49,25 +35,129 @@ public:
     QHash<int, QByteArray> roleNames() const override;
 
 private:
-    std::vector<LogMessage> m_messages;
+    struct Row {
+        LogMessage message;
+        // Null until the row is first shown
+        mutable QString text;
+    };
+
+    std::vector<Row> m_rows;
+};
+
+// Runs at most one evaluation at a time. A request made while an evaluation is running cancels it and waits as the
+// pending request, replacing any earlier pending request, so a burst of edits results in at most one extra run.
+// Edits are previewed, and the full evaluation follows once the editor has been idle.
+class BackgroundExecutor : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool isBusy READ isBusy NOTIFY isBusyChanged);
+    Q_PROPERTY(int typingDelay READ typingDelay NOTIFY typingDelayChanged);
+    // Fraction of the top-level statements of the current run that have finished
+    Q_PROPERTY(double progress READ progress NOTIFY progressChanged);
+    Q_PROPERTY(LogMessageModel *messages READ messages CONSTANT);
+
+public:
+    BackgroundExecutor();
+    ~BackgroundExecutor();
+
+    Q_INVOKABLE void execute(QString code);
+    bool isBusy() const;
+
+    // How long to wait after an edit before executing, in milliseconds. Follows the average cost of recent runs so
+    // that cheap scripts update quickly while expensive ones aren't restarted on every keystroke.
+    int typingDelay() const;
+
+    LogMessageModel *messages() { return &m_messages; }
+    double progress() const { return m_progress; }
+
+signals:
+    void result(BackgroundExecutorResult *result);
+    // The shapes of the top-level statements finished so far in a long run, without messages
+    void partialResult(BackgroundExecutorResult *result);
+    // Diagnostics and placeholder shapes from the proxy run, while the full run is still going
+    void proxyResult(BackgroundExecutorResult *result);
+    void isBusyChanged();
+    void typingDelayChanged();
+    void progressChanged();
+
+private:
+    struct Request {
+        QString code;
+        Fidelity fidelity;
+    };
+
+    void request(QString code, Fidelity fidelity);
+    void start(QString code, Fidelity fidelity);
+    void cancelRuns();
+    void runFullIfIdle();
+    void finished(Fidelity fidelity, bool canceled, qint64 elapsedMs);
+    void publish(BackgroundExecutorResult *r);
+    void publishPartial(BackgroundExecutorResult *r);
+    void publishProxy(BackgroundExecutorResult *r);
+    void setProgress(double progress);
+
+    Executor m_executor;
+    std::shared_ptr<ExecutorRun> m_run;
+    std::shared_ptr<ExecutorRun> m_proxyRun;
+    QThreadPool m_threadPool;
+    // Only accessed from the GUI thread.
+    bool m_running = false;
+    std::optional<Request> m_pending;
+    // The latest code from the editor, and the timer that waits for it to settle
+    QString m_code;
+    QTimer m_idleTimer;
+    double m_averageRunTime = 0.0;
+    double m_progress = 0.0;
+    LogMessageModel m_messages;
+    // The latest result, owned by the executor
+    BackgroundExecutorResult *m_result = nullptr;
+    BackgroundExecutorResult *m_partialResult = nullptr;
+    BackgroundExecutorResult *m_proxyResult = nullptr;
 };
 
+// Immutable result of a run. The shapes are shared, without copying, with the value the executor returned, and the
+// renderer and exporter hold on to them while they use them. The executor deletes a result once a newer one
+// replaces it, and the shapes are freed when their last user is done.
 class BackgroundExecutorResult : public QObject {
     Q_OBJECT
 
     Q_PROPERTY(bool hasShapes READ hasShapes CONSTANT);
+    Q_PROPERTY(qint64 memoryUsage READ memoryUsage CONSTANT);
+    Q_PROPERTY(bool isPartial READ isPartial CONSTANT);
+    Q_PROPERTY(bool isProxy READ isProxy CONSTANT);
+    Q_PROPERTY(bool isPreview READ isPreview CONSTANT);
 
 public:
-    BackgroundExecutorResult(const BackgroundExecutorResult &other) : m_messages(other.m_messages), m_shapes(other.m_shapes) { }
-    BackgroundExecutorResult(std::vector<LogMessage> messages, std::optional<ShapeList> shapes) : m_messages(messages), m_shapes(shapes) { }
+    enum class Kind {
+        Final,
+        // The shapes of the top-level statements finished so far, without messages
+        Partial,
+        // From a proxy run, see Fidelity::Proxy
+        Proxy,
+    };
+
+    BackgroundExecutorResult(std::vector<LogMessage> messages, std::shared_ptr<const ShapeList> shapes, qint64 memoryUsage,
+                             Kind kind = Kind::Final, bool isPreview = false)
+        : m_messages(std::move(messages)), m_shapes(std::move(shapes)), m_memoryUsage(memoryUsage), m_kind(kind),
+          m_isPreview(isPreview) { }
 
 public:
-    Q_INVOKABLE const LogMessageModel *messagesModel() const;
     const std::vector<LogMessage> &messages() const { return m_messages; }
-    const std::optional<ShapeList> &shapes() const { return m_shapes; }
-    bool hasShapes() const { return m_shapes.has_value(); }
+    // Null if the run did not produce shapes
+    const std::shared_ptr<const ShapeList> &shapes() const { return m_shapes; }
+    bool hasShapes() const { return m_shapes != nullptr; }
+    // Approximate size of the display meshes of the shapes, in bytes
+    qint64 memoryUsage() const { return m_memoryUsage; }
+    bool isPartial() const { return m_kind == Kind::Partial; }
+    bool isProxy() const { return m_kind == Kind::Proxy; }
+    // Whether a preview run left out work, see Fidelity::Preview
+    bool isPreview() const { return m_isPreview; }
 
 private:
     std::vector<LogMessage> m_messages;
-    std::optional<ShapeList> m_shapes;
+    std::shared_ptr<const ShapeList> m_shapes;
+    qint64 m_memoryUsage = 0;
+    Kind m_kind;
+    bool m_isPreview;
 };
@@ -0,0 +1,139 @@
+#include <filesystem>
+
+#include <Message_ProgressIndicator.hxx>
+#include <Message_ProgressScope.hxx>
+
+#include "backgroundexecutor.h"
+#include "backgroundexporter.h"
+
+// Forwards OCCT progress to the GUI thread and cancels the export when the job is canceled. Updates are throttled to
+// one percent steps so that fine-grained scopes don't flood the event loop.
+class ExportProgress : public Message_ProgressIndicator
+{
+public:
+    ExportProgress(BackgroundExporter *exporter, std::shared_ptr<BackgroundExporter::Job> job)
+        : m_exporter(exporter), m_job(std::move(job)) { }
+
+    Standard_Boolean UserBreak() override {
+        return m_job->canceled;
+    }
+
+protected:
+    void Show(const Message_ProgressScope &, const Standard_Boolean isForce) override {
+        const double position = GetPosition();
+        if (!isForce && position - m_lastShown < 0.01) {
+            return;
+        }
+
+        m_lastShown = position;
+        QMetaObject::invokeMethod(m_exporter, [exporter = m_exporter, job = m_job, position] {
+            exporter->setProgress(job, position);
+        }, Qt::QueuedConnection);
+    }
+
+    void Reset() override {
+        Message_ProgressIndicator::Reset();
+        m_lastShown = 0.0;
+    }
+
+private:
+    BackgroundExporter *m_exporter;
+    std::shared_ptr<BackgroundExporter::Job> m_job;
+    double m_lastShown = 0.0;
+};
+
+BackgroundExporter::BackgroundExporter() {
+    m_threadPool.setMaxThreadCount(1);
+}
+
+BackgroundExporter::~BackgroundExporter() {
+    for (const auto &job : m_jobs) {
+        job->canceled = true;
+    }
+
+    m_threadPool.waitForDone();
+}
+
+void BackgroundExporter::exportResult(BackgroundExecutorResult *result, QUrl url) {
+    if (!result || !result->shapes() || result->shapes()->empty()) {
+        m_status = "Nothing to export";
+        emit statusChanged();
+        return;
+    }
+
+    // A preview leaves out chamfers, fillets and booleans, so it is not the model the code describes
+    if (result->isPreview()) {
+        m_status = "Cannot export a preview, wait for the full result";
+        emit statusChanged();
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->path = url.toLocalFile().toStdString();
+    job->shapes = result->shapes();
+
+    m_jobs.push_back(job);
+    if (m_jobs.size() == 1) {
+        started(job);
+    }
+
+    emit statusChanged();
+
+    m_threadPool.start([this, job]() { run(job); });
+}
+
+void BackgroundExporter::cancel() {
+    for (const auto &job : m_jobs) {
+        job->canceled = true;
+    }
+}
+
+void BackgroundExporter::run(std::shared_ptr<Job> job) {
+    ExportResult result{false, "canceled"};
+
+    if (!job->canceled) {
+        Handle(ExportProgress) indicator = new ExportProgress(this, job);
+        result = exportShapes(job->path, *job->shapes, {}, indicator->Start());
+    }
+
+    QMetaObject::invokeMethod(this, [this, job, result] { finish(job, result); }, Qt::QueuedConnection);
+}
+
+void BackgroundExporter::started(const std::shared_ptr<Job> &job) {
+    m_progress = 0.0;
+    m_status = QString("Exporting %1").arg(QString::fromStdString(std::filesystem::path(job->path).filename().string()));
+}
+
+void BackgroundExporter::setProgress(const std::shared_ptr<Job> &job, double progress) {
+    if (m_jobs.empty() || m_jobs.front() != job) {
+        return;
+    }
+
+    m_progress = progress;
+    emit statusChanged();
+}
+
+void BackgroundExporter::finish(const std::shared_ptr<Job> &job, ExportResult result) {
+    std::erase(m_jobs, job);
+
+    const auto path = QString::fromStdString(job->path);
+    const auto filename = QString::fromStdString(std::filesystem::path(job->path).filename().string());
+
+    if (result.ok) {
+        m_status = QString("Exported %1").arg(filename);
+    } else if (job->canceled) {
+        m_status = QString("Export of %1 canceled").arg(filename);
+    } else {
+        m_status = QString("Export of %1 failed: %2").arg(filename, QString::fromStdString(result.error));
+    }
+
+    m_progress = 0.0;
+
+    // Keep the final status of the last job visible, but show the next one as soon as it starts.
+    if (!m_jobs.empty() && !m_jobs.front()->canceled) {
+        started(m_jobs.front());
+    }
+
+    emit statusChanged();
+    emit finished(path, result.ok, QString::fromStdString(result.error));
+}
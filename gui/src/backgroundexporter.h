@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <QObject>
+#include <QThreadPool>
+#include <QUrl>
+
+#include "export.h"
+
+class BackgroundExecutorResult;
+
+// Runs exports on a dedicated single thread pool so that long exports neither block the GUI nor the executor. Exports
+// are queued and run one at a time in the order they were requested.
+class BackgroundExporter : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool isBusy READ isBusy NOTIFY statusChanged);
+    Q_PROPERTY(double progress READ progress NOTIFY statusChanged);
+    Q_PROPERTY(int queuedCount READ queuedCount NOTIFY statusChanged);
+    Q_PROPERTY(QString status READ status NOTIFY statusChanged);
+
+public:
+    BackgroundExporter();
+    ~BackgroundExporter();
+
+    Q_INVOKABLE void exportResult(BackgroundExecutorResult *result, QUrl url);
+    // Cancels the running export and everything queued after it.
+    Q_INVOKABLE void cancel();
+
+    bool isBusy() const { return !m_jobs.empty(); }
+    double progress() const { return m_progress; }
+    int queuedCount() const { return std::max<int>(0, m_jobs.size() - 1); }
+    QString status() const { return m_status; }
+
+signals:
+    void statusChanged();
+    void finished(QString path, bool ok, QString error);
+
+private:
+    struct Job {
+        std::string path;
+        std::shared_ptr<const ShapeList> shapes;
+        std::atomic<bool> canceled = false;
+    };
+
+    friend class ExportProgress;
+
+    void run(std::shared_ptr<Job> job);
+    void started(const std::shared_ptr<Job> &job);
+    void setProgress(const std::shared_ptr<Job> &job, double progress);
+    void finish(const std::shared_ptr<Job> &job, ExportResult result);
+
+    QThreadPool m_threadPool;
+    // Jobs that have not finished yet, in order. Only accessed from the GUI thread.
+    std::vector<std::shared_ptr<Job>> m_jobs;
+    double m_progress = 0.0;
+    QString m_status;
+};
@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <functional>
+#include <tuple>
+#include <unordered_map>
+
 #include <QQuickTextDocument>
 #include <QRegularExpression>
 #include <QSyntaxHighlighter>
@@ -14,6 +19,23 @@ int leadingSpaceCount(QString str) {
     return spaces;
 }
 
+bool messageLess(const LogMessage &a, const LogMessage &b) {
+    return std::tie(a.span.begin, a.span.end, a.level, a.message) < std::tie(b.span.begin, b.span.end, b.level, b.message);
+}
+
+void combineHash(size_t &h, size_t value) {
+    h ^= value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+}
+
+// A message as drawn on a block. The span is taken relative to the block, so text edited above does not change it.
+size_t messageHash(const LogMessage &msg, int blockPosition) {
+    size_t h = std::hash<std::string>{}(msg.message);
+    combineHash(h, std::hash<int>{}(msg.span.begin - blockPosition));
+    combineHash(h, std::hash<int>{}(msg.span.end - blockPosition));
+    combineHash(h, std::hash<int>{}(static_cast<int>(msg.level)));
+    return h;
+}
+
 }
 
 class SyntaxHighlighter : public QSyntaxHighlighter {
@@ -25,10 +47,24 @@ class SyntaxHighlighter : public QSyntaxHighlighter {
         int direction = -1;
     };
 
+    struct Token {
+        int start;
+        int length;
+        int formatIndex;
+    };
+
+    // Tokenizer output for a block, reused as long as its text and the state it starts in are unchanged, so that
+    // rehighlighting a block for messages or spans does not run the regex again
     struct BlockData : public QTextBlockUserData {
         QList<BracketInfo> brackets;
-
-        BlockData(QList<BracketInfo> brackets) : brackets(brackets) { }
+        QString text;
+        int previousState = -1;
+        int state = -1;
+        // Position of the block when brackets were computed
+        int position = 0;
+        std::vector<Token> tokens;
+        // Combined messageHash of the messages drawn on the block, 0 for none
+        size_t messagesHash = 0;
     };
 
 public:
@@ -72,9 +108,37 @@ public:
         }
     }
 
+    // Only rehighlights the blocks whose messages differ from the ones drawn on them. Blocks are compared by what they
+    // show rather than through the spans of the previous messages, which point at other text once lines were added or
+    // removed above them.
     void setMessages(const std::vector<LogMessage> &messages) {
-        m_messages = messages;
-        rehighlight();
+        std::vector<LogMessage> shown;
+        for (const auto &msg : messages) {
+            if (msg.level != LogMessage::Level::Info && !msg.span.isEmpty()) {
+                shown.push_back(msg);
+            }
+        }
+
+        std::sort(shown.begin(), shown.end(), messageLess);
+        m_messages = std::move(shown);
+
+        // In the order highlightMessages combines them
+        std::unordered_map<int, size_t> expected;
+        for (const auto &msg : m_messages) {
+            for (auto it = document()->findBlock(msg.span.begin); it.isValid() && it.position() <= msg.span.end; it = it.next()) {
+                combineHash(expected[it.blockNumber()], messageHash(msg, it.position()));
+            }
+        }
+
+        for (auto it = document()->begin(); it.isValid(); it = it.next()) {
+            const auto data = static_cast<BlockData *>(it.userData());
+            const auto found = expected.find(it.blockNumber());
+            const size_t hash = found != expected.end() ? found->second : 0;
+
+            if ((data ? data->messagesHash : 0) != hash) {
+                rehighlightBlock(it);
+            }
+        }
     }
 
     QList<SpanObj> highlightedSpans() const {
@@ -172,23 +236,60 @@ protected:
     }
 
     void highlightCode(const QString &text) {
-        int state = ~previousBlockState();
+        const int previousState = previousBlockState();
+        const int blockPosition = currentBlock().position();
+
+        auto data = static_cast<BlockData *>(currentBlockUserData());
+        if (data && data->text == text && data->previousState == previousState) {
+            // Text above may have been edited since
+            for (auto &bracket : data->brackets) {
+                bracket.position += blockPosition - data->position;
+            }
+            data->position = blockPosition;
+        } else {
+            data = tokenize(text, previousState, blockPosition);
+            setCurrentBlockUserData(data);
+        }
+
+        for (const auto &token : data->tokens) {
+            auto format = m_formats[token.formatIndex];
+            const int position = blockPosition + token.start;
+
+            if (position == m_cursorBracketPosition || position == m_matchingBracketPosition) {
+                format.setBackground(QColor::fromRgb(0x80, 0xff, 0x80));
+            }
+
+            if (position == m_matchingBracketPosition) {
+                format.setFontWeight(QFont::Bold);
+            }
+
+            setFormat(token.start, token.length, format);
+        }
+
+        setCurrentBlockState(data->state);
+    }
+
+    BlockData *tokenize(const QString &text, int previousState, int blockPosition) const {
+        auto data = new BlockData;
+        data->text = text;
+        data->previousState = previousState;
+        data->position = blockPosition;
+
+        int state = ~previousState;
         int bracketLevel = state & c_bracketLevelMask;
         bool inComment = state & c_inComment;
 
-        QList<BracketInfo> brackets;
-
         auto it = m_re.globalMatch(text);
         while (it.hasNext()) {
             auto match = it.next();
-            int position = match.capturedStart() + currentBlock().position();
+            int position = match.capturedStart() + blockPosition;
             int index = match.lastCapturedIndex();
 
             switch (index) {
                 case c_beginBracket:
                     if (!inComment) {
                         bracketLevel++;
-                        brackets.emplaceBack(position, bracketLevel, 1);
+                        data->brackets.emplaceBack(position, bracketLevel, 1);
                     }
                     break;
                 case c_beginBlockComment:
@@ -205,23 +306,13 @@ protected:
             }
 
             if (formatIndex < m_formats.size()) {
-                auto format = m_formats[formatIndex];
-
-                if (position == m_cursorBracketPosition || position == m_matchingBracketPosition) {
-                    format.setBackground(QColor::fromRgb(0x80, 0xff, 0x80));
-                }
-
-                if (position == m_matchingBracketPosition) {
-                    format.setFontWeight(QFont::Bold);
-                }
-
-                setFormat(match.capturedStart(), match.capturedLength(), format);
+                data->tokens.push_back(Token{static_cast<int>(match.capturedStart()), static_cast<int>(match.capturedLength()), formatIndex});
             }
 
             switch (index) {
                 case c_endBracket:
                     if (!inComment) {
-                        brackets.emplaceBack(position, bracketLevel, -1);
+                        data->brackets.emplaceBack(position, bracketLevel, -1);
                         bracketLevel--;
                     }
                     break;
@@ -232,20 +323,19 @@ protected:
         }
 
         state = (inComment ? c_inComment : 0) | (bracketLevel & c_bracketLevelMask);
-        setCurrentBlockState(~state);
+        data->state = ~state;
 
-        if (!brackets.isEmpty()) {
-            setCurrentBlockUserData(new BlockData{brackets});
-        }
+        return data;
     }
 
     void highlightMessages() {
-        for (const auto &msg : m_messages) {
-            if (msg.level == LogMessage::Level::Info) {
-                continue;
-            }
+        const int blockPosition = currentBlock().position();
+        size_t hash = 0;
 
+        for (const auto &msg : m_messages) {
             if (currentBlockContainsSpan(msg.span)) {
+                combineHash(hash, messageHash(msg, blockPosition));
+
                 auto color = (msg.level == LogMessage::Level::Error ? QColor::fromRgb(0xff, 0x00, 0x00) : QColor::fromRgb(0x88, 0x88, 0x00));
 
                 QTextCharFormat format;
@@ -256,6 +346,8 @@ protected:
                 setSpanFormat(msg.span, format);
             }
         }
+
+        static_cast<BlockData *>(currentBlockUserData())->messagesHash = hash;
     }
 
     void highlightSpans() {
@@ -295,19 +387,13 @@ protected:
 
     void rehighlightSpans(const QList<SpanObj> &spans) {
         for (const auto &span : spans) {
-            auto it = document()->findBlock(span.begin);
-
-            do {
-                int posBefore = it.position();
-
-                rehighlightBlock(it);
+            rehighlightSpan(span);
+        }
+    }
 
-                it = it.next();
-                if (it.position() <= posBefore) {
-                    // not sure why this sometimes gets stuck in an infinite loop
-                    break;
-                }
-            } while (it != document()->end() && it.position() >= span.end);
+    void rehighlightSpan(const Span &span) {
+        for (auto it = document()->findBlock(span.begin); it.isValid() && it.position() <= span.end; it = it.next()) {
+            rehighlightBlock(it);
         }
     }
 
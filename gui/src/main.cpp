@@ -11,6 +11,7 @@
 
 #include "parser.h"
 #include "backgroundexecutor.h"
+#include "backgroundexporter.h"
 
 int main(int argc, char *argv[])
 {
@@ -23,6 +24,9 @@ int main(int argc, char *argv[])
     BackgroundExecutor executorManager;
     engine.rootContext()->setContextProperty("executor", &executorManager);
 
+    BackgroundExporter exporter;
+    engine.rootContext()->setContextProperty("exporter", &exporter);
+
     QUrl fileToLoad;
 
     const auto args = QGuiApplication::arguments();
@@ -0,0 +1,85 @@
+#include <algorithm>
+
+#include <QThread>
+
+#include <BRep_Tool.hxx>
+#include <BRepBuilderAPI_Copy.hxx>
+#include <Poly_Triangulation.hxx>
+#include <Prs3d_Drawer.hxx>
+#include <StdPrs_ToolTriangulatedShape.hxx>
+#include <TopExp.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+#include <TopoDS.hxx>
+
+#include "meshcache.h"
+#include "meshrefiner.h"
+
+namespace {
+
+// Keeps the viewport interactive on software rendering
+const int c_triangleBudget = 2'000'000;
+
+}
+
+int triangleCount(const TopoDS_Shape &shape) {
+    TopTools_IndexedMapOfShape faces;
+    TopExp::MapShapes(shape, TopAbs_FACE, faces);
+
+    int count = 0;
+    for (int i = 1; i <= faces.Extent(); i++) {
+        TopLoc_Location location;
+        if (const auto &tri = BRep_Tool::Triangulation(TopoDS::Face(faces(i)), location); !tri.IsNull()) {
+            count += tri->NbTriangles();
+        }
+    }
+
+    return count;
+}
+
+MeshRefiner::MeshRefiner() {
+    m_threadPool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 2));
+}
+
+MeshRefiner::~MeshRefiner() {
+    cancel();
+    m_threadPool.waitForDone();
+}
+
+void MeshRefiner::refine(quint64 generation, std::vector<Request> requests, int sceneTriangles,
+                         std::function<void(RefinedShape)> done) {
+    cancel();
+
+    m_generation = generation;
+    m_sceneTriangles = sceneTriangles;
+
+    for (auto &request : requests) {
+        m_threadPool.start([this, generation, request = std::move(request), done] {
+            if (m_generation != generation || m_sceneTriangles >= c_triangleBudget) {
+                return;
+            }
+
+            Handle(Prs3d_Drawer) drawer = new Prs3d_Drawer;
+            const double deflection = StdPrs_ToolTriangulatedShape::GetDeflection(request.shape, drawer);
+
+            const int coarseTriangles = triangleCount(request.shape);
+
+            auto copy = BRepBuilderAPI_Copy(request.shape, false, false).Shape();
+            meshWithCache(copy, deflection, drawer->DeviationAngle());
+
+            const int triangles = triangleCount(copy);
+            if (m_sceneTriangles.fetch_add(triangles - coarseTriangles) + triangles - coarseTriangles > c_triangleBudget) {
+                m_sceneTriangles -= triangles - coarseTriangles;
+                return;
+            }
+
+            if (m_generation == generation) {
+                done(RefinedShape{generation, request.index, copy, triangles});
+            }
+        });
+    }
+}
+
+void MeshRefiner::cancel() {
+    m_generation = 0;
+    m_threadPool.clear();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include <QMetaType>
+#include <QThreadPool>
+
+#include <TopoDS_Shape.hxx>
+
+// A finer mesh for a displayed shape, made on a copy of its topology so that the presentation on screen keeps using
+// the coarse triangulation until the refined shape is swapped in.
+struct RefinedShape {
+    quint64 generation = 0;
+    size_t index = 0;
+    TopoDS_Shape shape;
+    int triangles = 0;
+};
+
+Q_DECLARE_METATYPE(RefinedShape)
+
+int triangleCount(const TopoDS_Shape &shape);
+
+// Refines display meshes in the background. Requests are made in priority order and refined to the deflection AIS
+// would use for the shape, as long as the scene stays within the triangle budget. A new request supersedes all
+// earlier ones.
+class MeshRefiner
+{
+public:
+    struct Request {
+        size_t index;
+        TopoDS_Shape shape;
+    };
+
+    MeshRefiner();
+    ~MeshRefiner();
+
+    // Starts refining the shapes in order. done is called from a worker thread for each refined shape.
+    void refine(quint64 generation, std::vector<Request> requests, int sceneTriangles,
+                std::function<void(RefinedShape)> done);
+    void cancel();
+
+private:
+    QThreadPool m_threadPool;
+    std::atomic<quint64> m_generation = 0;
+    std::atomic<int> m_sceneTriangles = 0;
+};
@@ -1,11 +1,21 @@
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "occtview.h"
 #include "backgroundexecutor.h"
+#include "meshrefiner.h"
+#include "spanindex.h"
 
 #include <QRunnable>
 
 #include <AIS_AnimationCamera.hxx>
+#include <AIS_ConnectedInteractive.hxx>
 #include <AIS_InteractiveContext.hxx>
 #include <AIS_ViewController.hxx>
 #include <AIS_ViewCube.hxx>
@@ -18,17 +28,45 @@
 #include <OpenGl_View.hxx>
 #include <OpenGl_Window.hxx>
 #include <Prs3d_DatumAspect.hxx>
+#include <Prs3d_Drawer.hxx>
+#include <Prs3d_IsoAspect.hxx>
+#include <Select3D_SensitiveBox.hxx>
+#include <SelectMgr_EntityOwner.hxx>
+#include <SelectMgr_Selection.hxx>
 #include <BRepBndLib.hxx>
+#include <Bnd_Box.hxx>
+#include <BRep_Builder.hxx>
 #include <BRepBuilderAPI_Copy.hxx>
 #include <BRepBuilderAPI_Transform.hxx>
 #include <BRepPrimAPI_MakeBox.hxx>
 #include <BRepPrimAPI_MakeCylinder.hxx>
 #include <StdSelect_BRepOwner.hxx>
-#include <STEPControl_Writer.hxx>
+#include <TopExp.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+#include <TopoDS_Compound.hxx>
 #include <TopoDS_Shape.hxx>
 #include <V3d_View.hxx>
 #include <V3d_Viewer.hxx>
 
+namespace {
+
+// Results with more shapes than this are displayed merged into batches by color and location
+const size_t c_mergeThreshold = 1000;
+// Batches divide the bounding box of the result into this many cells along each axis, so that they can still be culled
+const int c_mergeCells = 8;
+// In pixels
+const double c_cullingSize = 3.0;
+// Selection mode that picks a result shape by its bounding box only, see ResultShape
+const int c_boxSelectionMode = 100;
+
+int edgeCount(const TopoDS_Shape &shape) {
+    TopTools_IndexedMapOfShape edges;
+    TopExp::MapShapes(shape, TopAbs_EDGE, edges);
+    return edges.Extent();
+}
+
+}
+
 class ShapeOwner : public Standard_Transient {
     DEFINE_STANDARD_RTTI_INLINE(ShapeOwner, Standard_Transient)
 
@@ -37,9 +75,60 @@ public:
     virtual ~ShapeOwner() { }
 
     bool isHighlight = false;
+    // Stands in for a shape that a preview run did not compute, see Fidelity::Preview
+    bool isPreview = false;
     bool isHovered = false;
     bool willUnhover = false;
     QList<SpanObj> spans;
+    // What the presentation was built from, used to reuse it for an equal shape in the next result. The displayed
+    // shape is a refined copy once refinement is done.
+    TopoDS_Shape source;
+    std::string color;
+    bool isRefined = false;
+    int triangles = 0;
+    int edges = 0;
+    bool drawsFaceBoundaries = true;
+    // Whether the exact selection has replaced the box selection
+    bool hasExactSelection = false;
+    // For instances, the shared presentation they are connected to
+    Handle(AIS_Shape) prototype;
+    // Set for presentations that merge many result shapes. faces are the faces of the displayed compound, and
+    // faceMember maps each of them to its index in OcctRenderer::m_members.
+    bool isBatch = false;
+    TopTools_IndexedMapOfShape faces;
+    std::vector<size_t> faceMember;
+};
+
+// Presentation of a result shape. Its default selection is a single box around the shape, which is cheap to build
+// for every shape. The exact selection, with sensitive entities for every face and edge, is only built for shapes
+// once their box is picked.
+class ResultShape : public AIS_Shape {
+    DEFINE_STANDARD_RTTI_INLINE(ResultShape, AIS_Shape)
+
+public:
+    explicit ResultShape(const TopoDS_Shape &shape) : AIS_Shape(shape) { }
+
+    // Instances connected to this shape then copy its selection for every mode, including the box
+    Standard_Boolean AcceptShapeDecomposition() const override { return false; }
+
+    void ComputeSelection(const Handle(SelectMgr_Selection) &selection, const Standard_Integer mode) override {
+        if (mode != c_boxSelectionMode) {
+            AIS_Shape::ComputeSelection(selection, mode);
+            return;
+        }
+
+        Bnd_Box box;
+        BRepBndLib::Add(Shape(), box, true);
+        if (!box.IsVoid()) {
+            selection->Add(new Select3D_SensitiveBox(new SelectMgr_EntityOwner(this), box));
+        }
+    }
+};
+
+// A result shape displayed as part of a merged batch
+struct MergedMember {
+    TopoDS_Shape shape;
+    QList<SpanObj> spans;
 };
 
 class OcctRenderer : public QObject, public AIS_ViewController {
@@ -49,24 +138,44 @@ public:
     ~OcctRenderer() = default;
 
     void setParent(QQuickItem *parent) { m_parent = parent; }
-    void setResult(BackgroundExecutorResult *result);
+    void setResult(std::shared_ptr<const ShapeList> shapes);
+    void setProxies(const ShapeList &shapes);
 
     void setHoveredPosition(int position);
     void setShowHighlightedShapes(bool show);
+    void setEdgeBudget(int budget);
 
     void wheelEvent(int delta);
     void mouseEvent(QPointF pos, Qt::MouseButtons buttons, Qt::KeyboardModifiers modifiers);
 
     void updateView();
+    void updateVisibility(const Handle(AIS_InteractiveObject) &object);
+    void setHovered(const Handle(AIS_InteractiveObject) &object, bool hovered);
     void updateHoveredSpans();
 
+    void refineShapes();
+    void applyRefinement(const RefinedShape &refined);
+
+    Handle(AIS_Shape) makeAisShape(const TopoDS_Shape &shape, bool isHighlight, bool isPreview, const std::string &colorName);
+    Handle(AIS_Shape) presentedShape(const Handle(AIS_InteractiveObject) &object);
+
+    void setMergedResult(const ShapeList &shapes);
+    void clearMerged();
+    void updateHoverOverlay(const std::vector<size_t> &members);
+    void updateFaceBoundaries();
+    void activateExactSelection(const Handle(AIS_InteractiveObject) &object);
+
 signals:
     void hoveredSpansChanged(QList<SpanObj> spans);
+    void shapeRefined(RefinedShape refined);
 
 public slots:
     void init();
     void paint();
 
+protected:
+    void handleMoveTo(const Handle(AIS_InteractiveContext) &context, const Handle(V3d_View) &view) override;
+
 private:
     QQuickItem *m_parent = nullptr;
     Handle(OpenGl_GraphicDriver) m_driver;
@@ -76,8 +185,23 @@ private:
     Handle(V3d_Viewer) m_viewer;
     Handle(AIS_InteractiveContext) m_interactiveContext;
     Handle(AIS_ViewCube) m_viewCube;
-    std::vector<Handle(AIS_Shape)> m_shapes;
+    Handle(Prs3d_Drawer) m_hoverStyle;
+    std::vector<Handle(AIS_InteractiveObject)> m_shapes;
+    SpanIndex m_spanIndex;
+    int m_hoveredPosition = -1;
+    // Indices into m_shapes, or m_members in merged mode, of the shapes hovered in the editor, sorted
+    std::vector<size_t> m_codeHoveredShapes;
     bool m_showHighlightedShapes = true;
+    // Merged display mode, used for results with many shapes
+    std::vector<MergedMember> m_members;
+    std::vector<size_t> m_mouseHoveredMembers;
+    Handle(AIS_Shape) m_hoverOverlay;
+    // Placeholders from the proxy run, drawn as wireframe over the previous result
+    Handle(AIS_Shape) m_proxies;
+    int m_edgeBudget = 200000;
+    bool m_drawFaceBoundaries = true;
+    MeshRefiner m_refiner;
+    quint64 m_refineGeneration = 0;
 };
 
 OcctView::OcctView()
@@ -88,30 +212,33 @@ OcctView::OcctView()
 }
 
 void OcctView::setResult(BackgroundExecutorResult *result) {
-    scheduleRenderJob([this, result] { if (m_renderer) { m_renderer->setResult(result); } });
+    // A run without shapes, for example a failed or canceled one, keeps the previous result but not the placeholders,
+    // which would otherwise stay until the next run with shapes
+    if (!result->shapes()) {
+        scheduleRenderJob([this] { if (m_renderer) { m_renderer->setProxies({}); } });
+        return;
+    }
 
-    BRep_Builder builder;
-    builder.MakeCompound(m_resultCompound);
+    // The render job may run after the result object has been replaced, so it takes its own reference to the shapes
 
-    if (result->shapes()) {
-        for (const auto& sh : *result->shapes()) {
-            builder.Add(m_resultCompound, sh.shape());
+    const bool isProxy = result->isProxy();
+    const bool isPartial = result->isPartial();
+    scheduleRenderJob([this, shapes = result->shapes(), isProxy, isPartial] {
+        if (!m_renderer) {
+            return;
         }
-    }
-}
 
-void OcctView::exportResult(QUrl url) {
-    if (m_resultCompound.IsNull()) {
-        std::cerr << "null shape\n";
-        return;
-    }
-
-    STEPControl_Writer aWriter;
-    IFSelect_ReturnStatus stat = aWriter.Transfer(m_resultCompound, STEPControl_AsIs);
-    std::cerr << "Transfer status: " << stat << "\n";
+        if (isProxy) {
+            m_renderer->setProxies(*shapes);
+            return;
+        }
 
-    stat = aWriter.Write(url.toLocalFile().toLocal8Bit().data());
-    std::cerr << "WRite status: " << stat << "\n";
+        m_renderer->setResult(shapes);
+        // Placeholders stay until the run they stand in for is complete
+        if (!isPartial) {
+            m_renderer->setProxies({});
+        }
+    });
 }
 
 void OcctView::setHoveredPosition(int position) {
@@ -130,6 +257,14 @@ void OcctView::setShowHighlightedShapes(bool show) {
     }
 }   
 
+void OcctView::setEdgeBudget(int budget) {
+    if (budget != m_edgeBudget) {
+        m_edgeBudget = budget;
+        emit edgeBudgetChanged();
+        scheduleRenderJob([budget, this]() { if (m_renderer) { m_renderer->setEdgeBudget(budget); } });
+    }
+}
+
 void OcctView::mousePressEvent(QMouseEvent *ev)
 {
     handleMouseEvent(ev);
@@ -153,17 +288,74 @@ void OcctView::hoverMoveEvent(QHoverEvent *ev)
 void OcctView::wheelEvent(QWheelEvent *ev)
 {
     ev->accept();
-    int delta = ev->pixelDelta().y() / 3;
-    scheduleRenderJob([=, this] { if (m_renderer) { m_renderer->wheelEvent(delta); } });
+
+    {
+        std::lock_guard lock(m_inputMutex);
+        m_pendingWheel += ev->pixelDelta().y() / 3;
+    }
+
+    scheduleInput();
 }
 
+// Mouse moves are merged so that each frame only handles the latest position. A move is only merged into a previous
+// move with the same buttons and modifiers, so that clicks and drags still start and end where they did.
 void OcctView::handleMouseEvent(QSinglePointEvent *ev)
 {
     ev->accept();
-    auto pos = ev->position();
-    auto buttons = ev->buttons();
-    auto modifiers = ev->modifiers();
-    scheduleRenderJob([=, this] { if (m_renderer) { m_renderer->mouseEvent(pos, buttons, modifiers); } });
+    const bool isMove = ev->type() == QEvent::MouseMove || ev->type() == QEvent::HoverMove;
+    MouseInput input{ev->position(), ev->buttons(), ev->modifiers(), isMove};
+
+    {
+        std::lock_guard lock(m_inputMutex);
+        if (isMove && !m_pendingMouse.empty() && m_pendingMouse.back().isMove
+            && m_pendingMouse.back().buttons == input.buttons && m_pendingMouse.back().modifiers == input.modifiers) {
+            m_pendingMouse.back().pos = input.pos;
+        } else {
+            m_pendingMouse.push_back(input);
+        }
+    }
+
+    scheduleInput();
+}
+
+void OcctView::scheduleInput()
+{
+    {
+        std::lock_guard lock(m_inputMutex);
+        if (m_inputScheduled) {
+            return;
+        }
+
+        m_inputScheduled = true;
+    }
+
+    scheduleRenderJob([this] { flushInput(); });
+}
+
+// Runs on the render thread
+void OcctView::flushInput()
+{
+    std::vector<MouseInput> mouse;
+    int wheel;
+
+    {
+        std::lock_guard lock(m_inputMutex);
+        mouse.swap(m_pendingMouse);
+        wheel = std::exchange(m_pendingWheel, 0);
+        m_inputScheduled = false;
+    }
+
+    if (!m_renderer) {
+        return;
+    }
+
+    for (const auto &input : mouse) {
+        m_renderer->mouseEvent(input.pos, input.buttons, input.modifiers);
+    }
+
+    if (wheel != 0) {
+        m_renderer->wheelEvent(wheel);
+    }
 }
 
 void OcctView::handleWindowChanged(QQuickWindow *win)
@@ -185,6 +377,9 @@ void OcctView::sync() {
                 emit hoveredSpansChanged();
             }
         }, Qt::QueuedConnection);
+        connect(m_renderer, &OcctRenderer::shapeRefined, this, [this](RefinedShape refined) {
+            scheduleRenderJob([this, refined] { if (m_renderer) { m_renderer->applyRefinement(refined); } });
+        }, Qt::QueuedConnection);
     }
 
     m_renderer->setParent(this);
@@ -229,9 +424,22 @@ void OcctRenderer::mouseEvent(QPointF pos, Qt::MouseButtons buttons, Qt::Keyboar
         owner->willUnhover = owner->isHovered;
     }
 
+    m_mouseHoveredMembers.clear();
+
     for (m_interactiveContext->InitDetected(); m_interactiveContext->MoreDetected(); m_interactiveContext->NextDetected()) {
-        if (auto aisObject = Handle(AIS_InteractiveObject)::DownCast(m_interactiveContext->DetectedCurrentOwner()->Selectable())) {
+        const auto &detected = m_interactiveContext->DetectedCurrentOwner();
+        if (auto aisObject = Handle(AIS_InteractiveObject)::DownCast(detected->Selectable())) {
             if (auto owner = Handle(ShapeOwner)::DownCast(aisObject->GetOwner())) {
+                if (owner->isBatch) {
+                    // Batches are picked by face, which leads back to the result shape it came from
+                    if (auto brepOwner = Handle(StdSelect_BRepOwner)::DownCast(detected)) {
+                        if (const int face = owner->faces.FindIndex(brepOwner->Shape()); face > 0) {
+                            m_mouseHoveredMembers.push_back(owner->faceMember[face - 1]);
+                        }
+                    }
+                    continue;
+                }
+
                 owner->willUnhover = false;
 
                 if (!owner->isHovered) {
@@ -281,6 +489,12 @@ void OcctRenderer::init() {
 
     m_view = m_viewer->CreateView();
     m_view->SetImmediateUpdate(false);
+    m_view->ChangeRenderingParams().FrustumCullingState = Graphic3d_RenderingParams::FrustumCulling_On;
+
+    // Skip drawing shapes that would be only a few pixels in size
+    Graphic3d_ZLayerSettings layerSettings = m_viewer->ZLayerSettings(Graphic3d_ZLayerId_Default);
+    layerSettings.SetCullingSize(c_cullingSize);
+    m_viewer->SetZLayerSettings(Graphic3d_ZLayerId_Default, layerSettings);
 
     m_window = new Aspect_NeutralWindow;
     m_window->SetVirtual(true);
@@ -333,6 +547,11 @@ void OcctRenderer::init() {
     //Handle(Prs3d_LineAspect) line = new Prs3d_LineAspect(Quantity_NOC_WHITE, Aspect_TOL_SOLID, 2.0);
     m_interactiveContext->HighlightStyle()->SetColor(Quantity_NOC_WHITE);
     //m_interactiveContext->HighlightStyle()->SetLineAspect(line);
+
+    m_hoverStyle = new Prs3d_Drawer;
+    m_hoverStyle->SetColor(Quantity_NOC_WHITE);
+    m_hoverStyle->SetDisplayMode(AIS_Shaded);
+    m_hoverStyle->SetZLayer(Graphic3d_ZLayerId_Top);
 }
 
 void OcctRenderer::paint() {
@@ -355,8 +574,9 @@ void OcctRenderer::paint() {
 
     glContext->Functions()->glDisable(GL_BLEND);
 
+    // Only redraws what was invalidated: nothing if the view and scene are unchanged, and just the immediate layers
+    // for hover changes. The FBO keeps the last frame for the blit.
     m_fbo->BindBuffer(glContext);
-    m_view->InvalidateImmediate();
     FlushViewEvents(m_interactiveContext, m_view, true);
     m_fbo->UnbindBuffer(glContext);
 
@@ -377,51 +597,233 @@ void OcctRenderer::paint() {
     }
 }
 
-void OcctRenderer::setResult(BackgroundExecutorResult *result) {
-    if (!result->shapes()) {
+namespace {
+
+bool parseColor(const std::string &name, Quantity_Color &color) {
+    return !name.empty()
+        && (Quantity_Color::ColorFromHex(name.c_str(), color) || Quantity_Color::ColorFromName(name.c_str(), color));
+}
+
+}
+
+// Reuses the presentations of shapes that are unchanged since the previous result, that is the very same shape with
+// the same location and orientation. Only new shapes are displayed and only
+// shapes that went away are removed, and reused shapes whose highlight or color changed are restyled in place. Shapes
+// that change between preview and full style are displayed anew.
+// New shapes that share a TShape and style with another shape are displayed as instances of one prototype
+// presentation, so their mesh and GPU buffers exist only once.
+void OcctRenderer::setResult(std::shared_ptr<const ShapeList> shapes) {
+    bool center = m_shapes.empty();
+
+    if (shapes->size() > c_mergeThreshold) {
+        setMergedResult(*shapes);
+
+        if (center) {
+            m_view->SetProj(V3d_XnegYnegZpos, false);
+            m_view->FitMinMax(m_view->Camera(), m_view->View()->MinMaxValues(), 0.01);
+        }
         return;
     }
 
-    bool center = m_shapes.empty();
+    clearMerged();
 
-    for (const auto &sh : m_shapes) {
-        m_interactiveContext->Remove(sh, false);
+    using PrototypeKey = std::tuple<const TopoDS_TShape *, TopAbs_Orientation, bool, bool, std::string>;
+    std::map<PrototypeKey, Handle(AIS_Shape)> prototypes;
+
+    std::unordered_map<const TopoDS_TShape *, std::vector<size_t>> previousByTShape;
+    for (size_t i = 0; i < m_shapes.size(); i++) {
+        auto owner = Handle(ShapeOwner)::DownCast(m_shapes[i]->GetOwner());
+        previousByTShape[owner->source.TShape().get()].push_back(i);
+
+        if (owner->prototype) {
+            prototypes[{owner->source.TShape().get(), owner->source.Orientation(), owner->isHighlight, owner->isPreview,
+                        owner->color}] = owner->prototype;
+        }
     }
 
-    m_shapes.clear();
+    std::vector<bool> reused(m_shapes.size(), false);
 
-    for (const auto &sh : *result->shapes()) {
-        Handle(ShapeOwner) owner = new ShapeOwner();
-        std::transform(sh.spans().cbegin(), sh.spans().cend(), std::back_inserter(owner->spans), [](const auto &s) { return SpanObj(s); });
+    auto takePrevious = [&](const TopoDS_Shape &shape) -> std::optional<size_t> {
+        auto it = previousByTShape.find(shape.TShape().get());
+        if (it == previousByTShape.end()) {
+            return std::nullopt;
+        }
+
+        for (const auto i : it->second) {
+            if (!reused[i] && Handle(ShapeOwner)::DownCast(m_shapes[i]->GetOwner())->source.IsEqual(shape)) {
+                reused[i] = true;
+                return i;
+            }
+        }
+
+        return std::nullopt;
+    };
+
+    struct Entry {
+        Handle(AIS_InteractiveObject) object;
+        bool isHighlight;
+        bool isPreview;
+        std::string color;
+        QList<SpanObj> spans;
+    };
+
+    const auto &resultShapes = *shapes;
+    std::vector<Entry> entries(resultShapes.size());
+    // New shapes and reused shapes whose highlight flag may have changed their visibility
+    std::vector<Handle(AIS_InteractiveObject)> changed;
+
+    for (size_t n = 0; n < resultShapes.size(); n++) {
+        const auto &sh = resultShapes[n];
+        auto &entry = entries[n];
+
+        entry.isHighlight = sh.hasProp("highlight");
+        entry.isPreview = sh.hasProp("preview");
+        entry.color = entry.isHighlight ? std::string{} : sh.getProp("color").as<std::string>();
+        std::transform(sh.spans().cbegin(), sh.spans().cend(), std::back_inserter(entry.spans), [](const auto &s) { return SpanObj(s); });
+
+        auto previous = takePrevious(sh.shape());
+        if (!previous) {
+            continue;
+        }
 
-        Handle(AIS_Shape) aisShape = new AIS_Shape(sh.shape());
-        aisShape->Attributes()->SetFaceBoundaryDraw(true);
+        const auto &object = m_shapes[*previous];
+        auto owner = Handle(ShapeOwner)::DownCast(object->GetOwner());
 
-        if (sh.hasProp("highlight")) {
-            owner->isHighlight = true;
+        if (entry.isPreview != owner->isPreview) {
+            reused[*previous] = false;
+            continue;
+        }
+
+        if (entry.isHighlight != owner->isHighlight || entry.color != owner->color) {
+            // The style of an instance belongs to its prototype
+            if (owner->prototype) {
+                reused[*previous] = false;
+                continue;
+            }
 
-            aisShape->SetColor(Quantity_Color{Quantity_NOC_RED});
-            aisShape->SetTransparency();
-        } else if (auto colorName = sh.getProp("color").as<std::string>(); !colorName.empty()) {
             Quantity_Color color;
-            if (Quantity_Color::ColorFromHex(colorName.c_str(), color)) {
-                aisShape->SetColor(color);
-            } else if (Quantity_Color::ColorFromName(colorName.c_str(), color)) {
-                aisShape->SetColor(color);
+            if (entry.isHighlight) {
+                m_interactiveContext->SetColor(object, Quantity_Color{Quantity_NOC_RED}, false);
+                m_interactiveContext->SetTransparency(object, 0.6, false);
+            } else {
+                if (parseColor(entry.color, color)) {
+                    m_interactiveContext->SetColor(object, color, false);
+                } else {
+                    m_interactiveContext->UnsetColor(object, false);
+                }
+
+                if (entry.isPreview) {
+                    m_interactiveContext->SetTransparency(object, 0.3, false);
+                } else {
+                    m_interactiveContext->UnsetTransparency(object, false);
+                }
             }
+
+            owner->isHighlight = entry.isHighlight;
+            owner->color = entry.color;
+            changed.push_back(object);
         }
 
-        Handle(Prs3d_LineAspect) line = new Prs3d_LineAspect(Quantity_NOC_BLACK, Aspect_TOL_SOLID, 2.0);
-        aisShape->Attributes()->SetFaceBoundaryAspect(line);
-        //aisShape->Attributes()->SetFaceBoundaryDraw(false);
-        aisShape->Attributes()->SetLineAspect(line);
+        owner->spans = entry.spans;
+        entry.object = object;
+    }
 
-        aisShape->SetOwner(owner);
+    // Shapes that will share a prototype, including ones from earlier results
+    std::map<PrototypeKey, int> useCount;
+    for (size_t n = 0; n < resultShapes.size(); n++) {
+        const auto &shape = resultShapes[n].shape();
+        if (!entries[n].object && !shape.IsNull()) {
+            useCount[{shape.TShape().get(), shape.Orientation(), entries[n].isHighlight, entries[n].isPreview,
+                      entries[n].color}]++;
+        }
+    }
 
-        m_shapes.push_back(aisShape);
+    for (const auto &[key, prototype] : prototypes) {
+        useCount[key]++;
     }
 
-    updateView();
+    for (size_t n = 0; n < resultShapes.size(); n++) {
+        auto &entry = entries[n];
+        if (entry.object) {
+            continue;
+        }
+
+        const auto &shape = resultShapes[n].shape();
+
+        Handle(ShapeOwner) owner = new ShapeOwner();
+        owner->spans = entry.spans;
+        owner->source = shape;
+        owner->triangles = triangleCount(shape);
+        owner->edges = edgeCount(shape);
+        owner->isHighlight = entry.isHighlight;
+        owner->isPreview = entry.isPreview;
+        owner->color = entry.color;
+        owner->drawsFaceBoundaries = m_drawFaceBoundaries;
+
+        const PrototypeKey key{shape.TShape().get(), shape.Orientation(), entry.isHighlight, entry.isPreview, entry.color};
+        if (!shape.IsNull() && useCount[key] > 1) {
+            auto &prototype = prototypes[key];
+            if (!prototype) {
+                prototype = makeAisShape(shape.Located(TopLoc_Location{}), entry.isHighlight, entry.isPreview, entry.color);
+                // Only tracks whether the shared mesh has been refined
+                prototype->SetOwner(new ShapeOwner());
+            }
+
+            Handle(AIS_ConnectedInteractive) instance = new AIS_ConnectedInteractive();
+            instance->Connect(prototype, shape.Location().Transformation());
+
+            owner->prototype = prototype;
+            owner->isRefined = Handle(ShapeOwner)::DownCast(prototype->GetOwner())->isRefined;
+            instance->SetOwner(owner);
+            entry.object = instance;
+        } else {
+            auto aisShape = makeAisShape(shape, entry.isHighlight, entry.isPreview, entry.color);
+            aisShape->SetOwner(owner);
+            entry.object = aisShape;
+        }
+
+        changed.push_back(entry.object);
+    }
+
+    for (const auto i : m_codeHoveredShapes) {
+        if (reused[i]) {
+            setHovered(m_shapes[i], false);
+        }
+    }
+
+    m_codeHoveredShapes.clear();
+
+    for (size_t i = 0; i < m_shapes.size(); i++) {
+        if (!reused[i]) {
+            m_interactiveContext->Remove(m_shapes[i], false);
+        }
+    }
+
+    m_shapes.clear();
+    m_shapes.reserve(entries.size());
+    for (auto &entry : entries) {
+        m_shapes.push_back(std::move(entry.object));
+    }
+
+    m_spanIndex.clear();
+    for (size_t i = 0; i < m_shapes.size(); i++) {
+        for (const auto &span : Handle(ShapeOwner)::DownCast(m_shapes[i]->GetOwner())->spans) {
+            m_spanIndex.add(span.begin, span.end, i);
+        }
+    }
+
+    m_spanIndex.build();
+
+    updateFaceBoundaries();
+
+    for (const auto &object : changed) {
+        updateVisibility(object);
+    }
+
+    // Updates the hover highlight for the new shapes, and the hovered spans
+    setHoveredPosition(m_hoveredPosition);
+
+    refineShapes();
 
     if (center) {
         m_view->SetProj(V3d_XnegYnegZpos, false);
@@ -429,59 +831,273 @@ void OcctRenderer::setResult(BackgroundExecutorResult *result) {
     }
 }
 
-void OcctRenderer::setHoveredPosition(int position) {
-    QList<SpanObj> hoveredSpans;
-    for (const auto &aisShape : m_shapes) {
-        auto owner = Handle(ShapeOwner)::DownCast(aisShape->GetOwner());
-        if (owner->isHovered) {
-            hoveredSpans.append(owner->spans);
+// Preview shapes are drawn translucent with dashed edges, so they are not mistaken for the result of the full run
+Handle(AIS_Shape) OcctRenderer::makeAisShape(const TopoDS_Shape &shape, bool isHighlight, bool isPreview,
+                                             const std::string &colorName) {
+    Handle(AIS_Shape) aisShape = new ResultShape(shape);
+    aisShape->Attributes()->SetFaceBoundaryDraw(m_drawFaceBoundaries);
+    // Results are meshed by BackgroundExecutor, never tessellate on the render thread
+    aisShape->Attributes()->SetAutoTriangulation(false);
+
+    Quantity_Color color;
+    if (isHighlight) {
+        aisShape->SetColor(Quantity_Color{Quantity_NOC_RED});
+        aisShape->SetTransparency();
+    } else if (parseColor(colorName, color)) {
+        aisShape->SetColor(color);
+    }
+
+    if (isPreview && !isHighlight) {
+        aisShape->SetTransparency(0.3);
+    }
+
+    Handle(Prs3d_LineAspect) line
+        = new Prs3d_LineAspect(Quantity_NOC_BLACK, isPreview ? Aspect_TOL_DASH : Aspect_TOL_SOLID, 2.0);
+    aisShape->Attributes()->SetFaceBoundaryAspect(line);
+    //aisShape->Attributes()->SetFaceBoundaryDraw(false);
+    aisShape->Attributes()->SetLineAspect(line);
+
+    return aisShape;
+}
+
+// The presentation that holds the mesh of a displayed object: the prototype of an instance, or the object itself
+Handle(AIS_Shape) OcctRenderer::presentedShape(const Handle(AIS_InteractiveObject) &object) {
+    auto owner = Handle(ShapeOwner)::DownCast(object->GetOwner());
+    return owner->prototype ? owner->prototype : Handle(AIS_Shape)::DownCast(object);
+}
+
+// Results arrive with a coarse preview mesh. Shapes that cover more of the screen, and then those nearer to the
+// camera, are refined first.
+void OcctRenderer::refineShapes() {
+    struct Candidate {
+        size_t index;
+        double screenSize;
+        double distance;
+    };
+
+    const gp_Pnt eye = m_view->Camera()->Eye();
+
+    std::vector<Candidate> candidates;
+    std::unordered_set<const AIS_Shape *> requestedPrototypes;
+    int sceneTriangles = 0;
+    for (size_t i = 0; i < m_shapes.size(); i++) {
+        auto owner = Handle(ShapeOwner)::DownCast(m_shapes[i]->GetOwner());
+        sceneTriangles += owner->triangles;
+        if (owner->isRefined || owner->source.IsNull()) {
+            continue;
         }
 
-        bool match = false;
-        for (const auto &span : owner->spans) {
-            if (span.begin <= position && position < span.end) {
-                match = true;
-                break;
-            }
+        // Instances are refined once through their prototype
+        if (owner->prototype && !requestedPrototypes.insert(owner->prototype.get()).second) {
+            continue;
         }
 
-        if (match != owner->isHovered) {
-            owner->isHovered = match;
+        Bnd_Box box;
+        BRepBndLib::Add(owner->source, box, true);
+        if (box.IsVoid()) {
+            continue;
+        }
 
-            if (m_showHighlightedShapes || !owner->isHighlight) {
-                Handle(Prs3d_LineAspect) line = new Prs3d_LineAspect(owner->isHovered ? Quantity_NOC_WHITE : Quantity_NOC_BLACK, Aspect_TOL_SOLID, 2.0);
-                aisShape->Attributes()->SetFaceBoundaryAspect(line);
-                aisShape->Attributes()->SetLineAspect(line);
-                aisShape->Attributes()->SetColor(owner->isHovered ? Quantity_NOC_WHITE : Quantity_NOC_BLACK);
+        double xmin, ymin, zmin, xmax, ymax, zmax;
+        box.Get(xmin, ymin, zmin, xmax, ymax, zmax);
+
+        int pxmin = std::numeric_limits<int>::max(), pymin = pxmin;
+        int pxmax = std::numeric_limits<int>::min(), pymax = pxmax;
+        for (int corner = 0; corner < 8; corner++) {
+            int px, py;
+            m_view->Convert(corner & 1 ? xmax : xmin, corner & 2 ? ymax : ymin, corner & 4 ? zmax : zmin, px, py);
+            pxmin = std::min(pxmin, px);
+            pymin = std::min(pymin, py);
+            pxmax = std::max(pxmax, px);
+            pymax = std::max(pymax, py);
+        }
 
-                m_interactiveContext->Remove(aisShape, false);
-                m_interactiveContext->Display(aisShape, AIS_Shaded, TopAbs_SHAPE, false);
+        const gp_Pnt center((xmin + xmax) / 2, (ymin + ymax) / 2, (zmin + zmax) / 2);
+        candidates.push_back(Candidate{i, std::hypot(pxmax - pxmin, pymax - pymin), eye.Distance(center)});
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.screenSize != b.screenSize ? a.screenSize > b.screenSize : a.distance < b.distance;
+    });
+
+    std::vector<MeshRefiner::Request> requests;
+    requests.reserve(candidates.size());
+    for (const auto &candidate : candidates) {
+        const auto &object = m_shapes[candidate.index];
+        requests.push_back(MeshRefiner::Request{candidate.index, presentedShape(object)->Shape()});
+    }
+
+    m_refiner.refine(++m_refineGeneration, std::move(requests), sceneTriangles, [this](RefinedShape refined) {
+        emit shapeRefined(refined);
+    });
+}
+
+void OcctRenderer::applyRefinement(const RefinedShape &refined) {
+    if (refined.generation != m_refineGeneration || refined.index >= m_shapes.size()) {
+        return;
+    }
+
+    const auto &object = m_shapes[refined.index];
+    auto owner = Handle(ShapeOwner)::DownCast(object->GetOwner());
+
+    if (owner->prototype) {
+        const auto prototype = owner->prototype;
+        Handle(ShapeOwner)::DownCast(prototype->GetOwner())->isRefined = true;
+
+        prototype->Set(refined.shape);
+        prototype->SetToUpdate();
+
+        for (const auto &instance : m_shapes) {
+            auto instanceOwner = Handle(ShapeOwner)::DownCast(instance->GetOwner());
+            if (instanceOwner->prototype != prototype) {
+                continue;
+            }
+
+            instanceOwner->isRefined = true;
+            instanceOwner->triangles = refined.triangles;
+            if (m_interactiveContext->IsDisplayed(instance)) {
+                m_interactiveContext->Redisplay(instance, false);
             }
         }
+    } else {
+        owner->isRefined = true;
+        owner->triangles = refined.triangles;
+
+        const auto aisShape = Handle(AIS_Shape)::DownCast(object);
+        aisShape->Set(refined.shape);
+        if (owner->isBatch) {
+            // The copy has new faces in the same order
+            owner->faces.Clear();
+            TopExp::MapShapes(refined.shape, TopAbs_FACE, owner->faces);
+        }
+
+        if (m_interactiveContext->IsDisplayed(aisShape)) {
+            m_interactiveContext->Redisplay(aisShape, false);
+        }
     }
 
     m_view->Invalidate();
+    m_parent->window()->update();
+}
+
+void OcctRenderer::setHoveredPosition(int position) {
+    m_hoveredPosition = position;
+
+    std::vector<size_t> hovered;
+    m_spanIndex.forEachContaining(position, [&](size_t i) { hovered.push_back(i); });
+    std::sort(hovered.begin(), hovered.end());
+    hovered.erase(std::unique(hovered.begin(), hovered.end()), hovered.end());
+
+    // In merged mode the index refers to members, which are shown hovered through an overlay
+    if (!m_members.empty()) {
+        if (hovered != m_codeHoveredShapes) {
+            updateHoverOverlay(hovered);
+            m_codeHoveredShapes = std::move(hovered);
+            m_view->InvalidateImmediate();
+        }
+
+        updateHoveredSpans();
+        return;
+    }
+
+    if (hovered != m_codeHoveredShapes) {
+        for (const auto i : m_codeHoveredShapes) {
+            if (!std::binary_search(hovered.begin(), hovered.end(), i)) {
+                setHovered(m_shapes[i], false);
+            }
+        }
+
+        for (const auto i : hovered) {
+            if (!std::binary_search(m_codeHoveredShapes.begin(), m_codeHoveredShapes.end(), i)) {
+                setHovered(m_shapes[i], true);
+            }
+        }
+
+        m_codeHoveredShapes = std::move(hovered);
+
+        // The hover style lives in the immediate Top layer
+        m_view->InvalidateImmediate();
+    }
 
     updateHoveredSpans();
 }
 
+void OcctRenderer::setHovered(const Handle(AIS_InteractiveObject) &object, bool hovered) {
+    auto owner = Handle(ShapeOwner)::DownCast(object->GetOwner());
+    owner->isHovered = hovered;
+
+    if (hovered) {
+        m_interactiveContext->HilightWithColor(object, m_hoverStyle, false);
+    } else {
+        m_interactiveContext->Unhilight(object, false);
+    }
+}
+
 void OcctRenderer::setShowHighlightedShapes(bool show) {
     m_showHighlightedShapes = show;
 
     updateView();
 }
 
-void OcctRenderer::updateView() {
-    for (const auto &aisShape : m_shapes) {
-        auto owner = Handle(ShapeOwner)::DownCast(aisShape->GetOwner());
+void OcctRenderer::updateVisibility(const Handle(AIS_InteractiveObject) &object) {
+    auto owner = Handle(ShapeOwner)::DownCast(object->GetOwner());
 
-        if (m_showHighlightedShapes || !owner->isHighlight) {
-            m_interactiveContext->Display(aisShape, AIS_Shaded, TopAbs_SHAPE, false);
-        } else {
-            m_interactiveContext->Remove(aisShape, false);
+    if (m_showHighlightedShapes || !owner->isHighlight) {
+        const int selectionMode = !owner->hasExactSelection ? c_boxSelectionMode
+                                : owner->isBatch ? AIS_Shape::SelectionMode(TopAbs_FACE) : TopAbs_SHAPE;
+        m_interactiveContext->Display(object, AIS_Shaded, selectionMode, false);
+    } else {
+        m_interactiveContext->Remove(object, false);
+    }
+}
+
+// Shapes are first picked by their bounding box. Those under the cursor get their exact selection, and the pick is
+// repeated against it, so that only shapes the mouse has been over pay for their sensitive entities.
+void OcctRenderer::handleMoveTo(const Handle(AIS_InteractiveContext) &context, const Handle(V3d_View) &view) {
+    AIS_ViewController::handleMoveTo(context, view);
+
+    std::vector<Handle(AIS_InteractiveObject)> boxPicked;
+    for (context->InitDetected(); context->MoreDetected(); context->NextDetected()) {
+        auto object = Handle(AIS_InteractiveObject)::DownCast(context->DetectedCurrentOwner()->Selectable());
+        if (!object) {
+            continue;
+        }
+
+        auto owner = Handle(ShapeOwner)::DownCast(object->GetOwner());
+        if (owner && !owner->hasExactSelection) {
+            boxPicked.push_back(object);
         }
     }
 
+    if (boxPicked.empty()) {
+        return;
+    }
+
+    for (const auto &object : boxPicked) {
+        activateExactSelection(object);
+    }
+
+    const auto &pos = LastMousePosition();
+    context->MoveTo(pos.x(), pos.y(), view, false);
+}
+
+void OcctRenderer::activateExactSelection(const Handle(AIS_InteractiveObject) &object) {
+    auto owner = Handle(ShapeOwner)::DownCast(object->GetOwner());
+    if (owner->hasExactSelection) {
+        return;
+    }
+
+    owner->hasExactSelection = true;
+    m_interactiveContext->Deactivate(object, c_boxSelectionMode);
+    // Instances share the exact selection computed once for their prototype
+    m_interactiveContext->Activate(object, owner->isBatch ? AIS_Shape::SelectionMode(TopAbs_FACE) : TopAbs_SHAPE);
+}
+
+void OcctRenderer::updateView() {
+    for (const auto &object : m_shapes) {
+        updateVisibility(object);
+    }
+
     m_view->Invalidate();
 
     updateHoveredSpans();
@@ -495,7 +1111,241 @@ void OcctRenderer::updateHoveredSpans() {
             hoveredSpans.append(owner->spans);
         }
     }
+    for (const auto i : m_mouseHoveredMembers) {
+        hoveredSpans.append(m_members[i].spans);
+    }
     emit hoveredSpansChanged(hoveredSpans);
 }
 
+void OcctRenderer::setEdgeBudget(int budget) {
+    m_edgeBudget = budget;
+
+    updateFaceBoundaries();
+
+    m_view->Invalidate();
+}
+
+// Face boundaries are drawn as separate line primitives and dominate frame time on results with many edges
+void OcctRenderer::updateFaceBoundaries() {
+    int edges = 0;
+    for (const auto &object : m_shapes) {
+        edges += Handle(ShapeOwner)::DownCast(object->GetOwner())->edges;
+    }
+
+    m_drawFaceBoundaries = edges <= m_edgeBudget;
+
+    for (const auto &object : m_shapes) {
+        auto owner = Handle(ShapeOwner)::DownCast(object->GetOwner());
+        if (owner->drawsFaceBoundaries == m_drawFaceBoundaries) {
+            continue;
+        }
+
+        owner->drawsFaceBoundaries = m_drawFaceBoundaries;
+
+        auto aisShape = presentedShape(object);
+        if (aisShape->Attributes()->FaceBoundaryDraw() != m_drawFaceBoundaries) {
+            aisShape->Attributes()->SetFaceBoundaryDraw(m_drawFaceBoundaries);
+            aisShape->SetToUpdate();
+        }
+
+        if (m_interactiveContext->IsDisplayed(object)) {
+            m_interactiveContext->Redisplay(object, false);
+        }
+    }
+}
+
+// Displays many shapes as a few presentations: shapes with the same style in the same cell of a coarse grid over the
+// result are merged into one compound. Scene diffing is not done in this mode, and hover from the editor is shown
+// with an overlay of the hovered shapes instead of highlighting the batch.
+void OcctRenderer::setMergedResult(const ShapeList &shapes) {
+    clearMerged();
+
+    for (const auto &aisShape : m_shapes) {
+        m_interactiveContext->Remove(aisShape, false);
+    }
+
+    m_shapes.clear();
+    m_codeHoveredShapes.clear();
+
+    std::vector<Bnd_Box> boxes(shapes.size());
+    Bnd_Box sceneBox;
+    for (size_t i = 0; i < shapes.size(); i++) {
+        BRepBndLib::Add(shapes[i].shape(), boxes[i], true);
+        sceneBox.Add(boxes[i]);
+    }
+
+    double xmin = 0, ymin = 0, zmin = 0, xmax = 0, ymax = 0, zmax = 0;
+    if (!sceneBox.IsVoid()) {
+        sceneBox.Get(xmin, ymin, zmin, xmax, ymax, zmax);
+    }
+
+    auto cellOf = [&](const Bnd_Box &box) {
+        if (box.IsVoid()) {
+            return 0;
+        }
+
+        const auto center = (box.CornerMin().XYZ() + box.CornerMax().XYZ()) / 2;
+        auto cell = [](double v, double min, double max) {
+            return max > min ? std::clamp(static_cast<int>((v - min) / (max - min) * c_mergeCells), 0, c_mergeCells - 1) : 0;
+        };
+
+        return (cell(center.X(), xmin, xmax) * c_mergeCells + cell(center.Y(), ymin, ymax)) * c_mergeCells
+            + cell(center.Z(), zmin, zmax);
+    };
+
+    struct Batch {
+        bool isHighlight;
+        bool isPreview;
+        std::string color;
+        std::vector<size_t> members;
+    };
+
+    std::map<std::tuple<bool, bool, std::string, int>, Batch> batches;
+
+    for (size_t i = 0; i < shapes.size(); i++) {
+        const auto &sh = shapes[i];
+        if (sh.shape().IsNull()) {
+            continue;
+        }
+
+        const bool isHighlight = sh.hasProp("highlight");
+        const bool isPreview = sh.hasProp("preview");
+        const auto colorName = isHighlight ? std::string{} : sh.getProp("color").as<std::string>();
+
+        MergedMember member{sh.shape(), {}};
+        std::transform(sh.spans().cbegin(), sh.spans().cend(), std::back_inserter(member.spans), [](const auto &s) { return SpanObj(s); });
+
+        auto &batch = batches[{isHighlight, isPreview, colorName, cellOf(boxes[i])}];
+        batch.isHighlight = isHighlight;
+        batch.isPreview = isPreview;
+        batch.color = colorName;
+        batch.members.push_back(m_members.size());
+
+        m_members.push_back(std::move(member));
+    }
+
+    BRep_Builder builder;
+
+    for (const auto &[key, batch] : batches) {
+        Handle(ShapeOwner) owner = new ShapeOwner();
+        owner->isBatch = true;
+        owner->drawsFaceBoundaries = false;
+        owner->isHighlight = batch.isHighlight;
+        owner->isPreview = batch.isPreview;
+        owner->color = batch.color;
+
+        TopoDS_Compound compound;
+        builder.MakeCompound(compound);
+
+        for (const auto member : batch.members) {
+            const auto &shape = m_members[member].shape;
+            builder.Add(compound, shape);
+
+            TopExp::MapShapes(shape, TopAbs_FACE, owner->faces);
+            owner->faceMember.resize(owner->faces.Extent(), member);
+            owner->edges += edgeCount(shape);
+        }
+
+        owner->source = compound;
+        owner->triangles = triangleCount(compound);
+
+        auto aisShape = makeAisShape(compound, batch.isHighlight, batch.isPreview, batch.color);
+        aisShape->Attributes()->SetFaceBoundaryDraw(false);
+        aisShape->SetOwner(owner);
+
+        m_shapes.push_back(aisShape);
+    }
+
+    m_spanIndex.clear();
+    for (size_t i = 0; i < m_members.size(); i++) {
+        for (const auto &span : m_members[i].spans) {
+            m_spanIndex.add(span.begin, span.end, i);
+        }
+    }
+
+    m_spanIndex.build();
+
+    updateFaceBoundaries();
+
+    for (const auto &aisShape : m_shapes) {
+        updateVisibility(aisShape);
+    }
+
+    setHoveredPosition(m_hoveredPosition);
+
+    refineShapes();
+}
+
+void OcctRenderer::clearMerged() {
+    if (m_members.empty()) {
+        return;
+    }
+
+    for (const auto &aisShape : m_shapes) {
+        m_interactiveContext->Remove(aisShape, false);
+    }
+
+    m_shapes.clear();
+    m_members.clear();
+    m_mouseHoveredMembers.clear();
+    m_codeHoveredShapes.clear();
+    updateHoverOverlay({});
+}
+
+void OcctRenderer::updateHoverOverlay(const std::vector<size_t> &members) {
+    if (m_hoverOverlay) {
+        m_interactiveContext->Remove(m_hoverOverlay, false);
+        m_hoverOverlay.Nullify();
+    }
+
+    if (members.empty()) {
+        return;
+    }
+
+    BRep_Builder builder;
+    TopoDS_Compound compound;
+    builder.MakeCompound(compound);
+    for (const auto member : members) {
+        builder.Add(compound, m_members[member].shape);
+    }
+
+    m_hoverOverlay = new AIS_Shape(compound);
+    m_hoverOverlay->Attributes()->SetAutoTriangulation(false);
+    m_hoverOverlay->SetColor(Quantity_NOC_WHITE);
+    m_hoverOverlay->SetZLayer(Graphic3d_ZLayerId_Top);
+    m_interactiveContext->Display(m_hoverOverlay, AIS_Shaded, -1, false);
+}
+
+void OcctRenderer::setProxies(const ShapeList &shapes) {
+    if (m_proxies) {
+        m_interactiveContext->Remove(m_proxies, false);
+        m_proxies.Nullify();
+        m_view->Invalidate();
+    }
+
+    BRep_Builder builder;
+    TopoDS_Compound compound;
+    builder.MakeCompound(compound);
+    bool empty = true;
+    for (const auto &sh : shapes) {
+        if (!sh.shape().IsNull() && !sh.hasProp("highlight")) {
+            builder.Add(compound, sh.shape());
+            empty = false;
+        }
+    }
+
+    if (empty) {
+        return;
+    }
+
+    m_proxies = new AIS_Shape(compound);
+    m_proxies->Attributes()->SetAutoTriangulation(false);
+    // Only the edges, without isolines
+    m_proxies->Attributes()->SetUIsoAspect(new Prs3d_IsoAspect(Quantity_NOC_GRAY50, Aspect_TOL_SOLID, 1.0, 0));
+    m_proxies->Attributes()->SetVIsoAspect(new Prs3d_IsoAspect(Quantity_NOC_GRAY50, Aspect_TOL_SOLID, 1.0, 0));
+    m_proxies->SetColor(Quantity_NOC_GRAY50);
+    m_interactiveContext->Display(m_proxies, AIS_WireFrame, -1, false);
+    m_view->Invalidate();
+}
+
 #include "occtview.moc"
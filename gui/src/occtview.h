@@ -1,12 +1,15 @@
 #ifndef OCCTVIEW_H
 #define OCCTVIEW_H
 
+#include <mutex>
+#include <vector>
+
 #include <QQuickItem>
 #include <QQuickWindow>
 #include <QUrl>
-#include <TopoDS_Compound.hxx>
 
 #include "spanobj.h"
+#include "value.h"
 
 class BackgroundExecutorResult;
 class OcctRenderer;
@@ -19,12 +22,12 @@ class OcctView : public QQuickItem
     Q_PROPERTY(bool showHighlightedShapes READ showHighlightedShapes WRITE setShowHighlightedShapes NOTIFY showHighlightedShapesChanged)
     Q_PROPERTY(int hoveredPosition READ hoveredPosition WRITE setHoveredPosition NOTIFY hoveredPositionChanged);
     Q_PROPERTY(QList<SpanObj> hoveredSpans READ hoveredSpans NOTIFY hoveredSpansChanged)
+    Q_PROPERTY(int edgeBudget READ edgeBudget WRITE setEdgeBudget NOTIFY edgeBudgetChanged)
 
 public:
     OcctView();
 
     Q_INVOKABLE void setResult(BackgroundExecutorResult *result);
-    Q_INVOKABLE void exportResult(QUrl url);
 
     int hoveredPosition() const { return m_hoveredPosition; }
     void setHoveredPosition(int position);
@@ -34,10 +37,15 @@ public:
     bool showHighlightedShapes() const { return m_showHighlightedShapes; }
     void setShowHighlightedShapes(bool show);
 
+    // Face boundaries are not drawn when the result has more edges than this
+    int edgeBudget() const { return m_edgeBudget; }
+    void setEdgeBudget(int budget);
+
 signals:
     void showHighlightedShapesChanged();
     void hoveredPositionChanged();
     void hoveredSpansChanged();
+    void edgeBudgetChanged();
 
 protected:
     void mousePressEvent(QMouseEvent *ev) override;
@@ -54,13 +62,29 @@ private slots:
     void handleMouseEvent(QSinglePointEvent *ev);
 
 private:
+    struct MouseInput {
+        QPointF pos;
+        Qt::MouseButtons buttons;
+        Qt::KeyboardModifiers modifiers;
+        // Only moves are merged, so presses and releases keep their own position
+        bool isMove;
+    };
+
     void releaseResources() override;
+    void scheduleInput();
+    void flushInput();
 
     OcctRenderer *m_renderer = nullptr;
     int m_hoveredPosition = -1;
     QList<SpanObj> m_hoveredSpans;
     bool m_showHighlightedShapes = true;
-    TopoDS_Compound m_resultCompound;
+    int m_edgeBudget = 200000;
+
+    // Input waiting for the next frame, written on the GUI thread and consumed on the render thread
+    std::mutex m_inputMutex;
+    std::vector<MouseInput> m_pendingMouse;
+    int m_pendingWheel = 0;
+    bool m_inputScheduled = false;
 };
 
 #endif // OCCTVIEW_H
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+// Static interval index from source spans to the shapes they belong to. Intervals are sorted by their start, and a
+// segment tree over the sorted array holds the largest end in each range, so a lookup only visits subtrees that can
+// contain the position: O(log n + k) for k hits.
+class SpanIndex
+{
+public:
+    void add(int begin, int end, size_t value) {
+        if (begin < end) {
+            m_entries.push_back(Entry{begin, end, value});
+        }
+    }
+
+    void build() {
+        std::sort(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b) { return a.begin < b.begin; });
+
+        m_maxEnd.assign(m_entries.size() * 4, 0);
+        if (!m_entries.empty()) {
+            buildNode(1, 0, m_entries.size());
+        }
+    }
+
+    void clear() {
+        m_entries.clear();
+        m_maxEnd.clear();
+    }
+
+    // Calls f(value) for every interval containing position. A value is reported once per matching interval.
+    template <typename F>
+    void forEachContaining(int position, F &&f) const {
+        const auto limit = std::upper_bound(m_entries.begin(), m_entries.end(), position,
+                                            [](int pos, const Entry &e) { return pos < e.begin; }) - m_entries.begin();
+        if (limit > 0) {
+            visit(1, 0, m_entries.size(), limit, position, f);
+        }
+    }
+
+private:
+    struct Entry {
+        int begin;
+        int end;
+        size_t value;
+    };
+
+    int buildNode(size_t node, size_t lo, size_t hi) {
+        if (hi - lo == 1) {
+            return m_maxEnd[node] = m_entries[lo].end;
+        }
+
+        const size_t mid = (lo + hi) / 2;
+        return m_maxEnd[node] = std::max(buildNode(node * 2, lo, mid), buildNode(node * 2 + 1, mid, hi));
+    }
+
+    template <typename F>
+    void visit(size_t node, size_t lo, size_t hi, size_t limit, int position, F &f) const {
+        if (lo >= limit || m_maxEnd[node] <= position) {
+            return;
+        }
+
+        if (hi - lo == 1) {
+            f(m_entries[lo].value);
+            return;
+        }
+
+        const size_t mid = (lo + hi) / 2;
+        visit(node * 2, lo, mid, limit, position, f);
+        visit(node * 2 + 1, mid, hi, limit, position, f);
+    }
+
+    std::vector<Entry> m_entries;
+    std::vector<int> m_maxEnd;
+};
@@ -1,13 +1,258 @@
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <format>
+#include <limits>
+#include <map>
+#include <sstream>
 #include <QtTest>
+
+#include <BRep_Tool.hxx>
+#include <BRepBuilderAPI_MakeEdge.hxx>
+#include <BRepBuilderAPI_MakeFace.hxx>
+#include <BRepBuilderAPI_MakeVertex.hxx>
+#include <BRepBuilderAPI_MakeWire.hxx>
+#include <BRepBuilderAPI_Transform.hxx>
+#include <BRepPrimAPI_MakeBox.hxx>
+#include <TopAbs.hxx>
+#include <TopExp.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+#include <TopoDS.hxx>
+
 #include "helpers.h"
 #include "parser.h"
+#include "contexts.h"
 #include "executor.h"
+#include "export.h"
+#include "meshcache.h"
+#include "shapeio.h"
+#include "stepreader.h"
+#include "stl.h"
 
 char *toString(const Value &val) {
     return toAllocatedString(val);
 }
 
+namespace
+{
+
+using Triangles = std::vector<std::array<float, 9>>;
+
+// A unit tetrahedron, with outward winding
+const Triangles c_tetrahedron{
+    {0, 0, 0, 0, 1, 0, 1, 0, 0},
+    {0, 0, 0, 1, 0, 0, 0, 0, 1},
+    {0, 0, 0, 0, 0, 1, 0, 1, 0},
+    {1, 0, 0, 0, 1, 0, 0, 0, 1},
+};
+
+QByteArray binaryStl(const Triangles &triangles) {
+    QByteArray data(80, '\0');
+
+    const auto count = static_cast<uint32_t>(triangles.size());
+    data.append(reinterpret_cast<const char *>(&count), sizeof(count));
+
+    for (const auto &tri : triangles) {
+        data.append(12, '\0');
+        data.append(reinterpret_cast<const char *>(tri.data()), sizeof(float) * tri.size());
+        data.append(2, '\0');
+    }
+
+    return data;
+}
+
+QByteArray asciiStl(const Triangles &triangles) {
+    QByteArray data = "solid test\n";
+
+    for (const auto &tri : triangles) {
+        data += "facet normal 0 0 0\nouter loop\n";
+        for (size_t i = 0; i < tri.size(); i += 3) {
+            data += QByteArray("vertex ") + QByteArray::number(tri[i]) + " " + QByteArray::number(tri[i + 1]) + " "
+                + QByteArray::number(tri[i + 2]) + "\n";
+        }
+        data += "endloop\nendfacet\n";
+    }
+
+    return data + "endsolid test\n";
+}
+
+int countSubShapes(const TopoDS_Shape &shape, TopAbs_ShapeEnum type) {
+    TopTools_IndexedMapOfShape map;
+    TopExp::MapShapes(shape, type, map);
+    return map.Extent();
+}
+
+// A 2 x 2 square on the XY plane. "bent" bends its top edge inwards, and "hole" and "moved_hole" cut circular holes
+// that start at the same point. All variants have the same surface, corners and UV bounds, so they only differ in
+// their edges.
+TopoDS_Face testFace(const QString &variant) {
+    const auto v0 = BRepBuilderAPI_MakeVertex(gp_Pnt{0, 0, 0}).Vertex();
+    const auto v1 = BRepBuilderAPI_MakeVertex(gp_Pnt{2, 0, 0}).Vertex();
+    const auto v2 = BRepBuilderAPI_MakeVertex(gp_Pnt{2, 2, 0}).Vertex();
+    const auto v3 = BRepBuilderAPI_MakeVertex(gp_Pnt{0, 2, 0}).Vertex();
+
+    // Through (1, 1.5), between the same corners as the straight top edge
+    const gp_Circ arc{gp_Ax2{gp_Pnt{1, 2.75, 0}, gp::DZ(), gp::DX()}, 1.25};
+    const auto top = variant == "bent" ? BRepBuilderAPI_MakeEdge(arc, v3, v2).Edge()
+                                       : BRepBuilderAPI_MakeEdge(v3, v2).Edge();
+
+    BRepBuilderAPI_MakeWire outer;
+    outer.Add(BRepBuilderAPI_MakeEdge(v0, v1).Edge());
+    outer.Add(BRepBuilderAPI_MakeEdge(v1, v2).Edge());
+    outer.Add(top);
+    outer.Add(BRepBuilderAPI_MakeEdge(v3, v0).Edge());
+
+    BRepBuilderAPI_MakeFace face{gp_Pln{gp::XOY()}, outer.Wire()};
+    if (variant == "hole" || variant == "moved_hole") {
+        // Both circles start at (1.5, 1)
+        const auto circle = variant == "hole" ? gp_Circ{gp_Ax2{gp_Pnt{1, 1, 0}, gp::DZ(), gp::DX()}, 0.5}
+                                              : gp_Circ{gp_Ax2{gp_Pnt{1.2, 1, 0}, gp::DZ(), gp::DX()}, 0.3};
+        const auto hole = BRepBuilderAPI_MakeWire(BRepBuilderAPI_MakeEdge(circle).Edge()).Wire();
+        face.Add(TopoDS::Wire(hole.Reversed()));
+    }
+
+    return face.Face();
+}
+
+// Unit boxes that are instances of one box, moved along X by each offset
+ShapeList movedBoxes(const QList<double> &offsets) {
+    const TopoDS_Shape box = BRepPrimAPI_MakeBox(1, 1, 1).Shape();
+
+    ShapeList shapes;
+    for (const auto offset : offsets) {
+        gp_Trsf move;
+        move.SetTranslation(gp_Vec{offset, 0, 0});
+        shapes.push_back(Shape{box.Moved(TopLoc_Location{move})});
+    }
+
+    return shapes;
+}
+
+// The smallest X coordinate of the shape's vertices, at the shape's location
+double minX(const TopoDS_Shape &shape) {
+    TopTools_IndexedMapOfShape vertices;
+    TopExp::MapShapes(shape, TopAbs_VERTEX, vertices);
+
+    double x = std::numeric_limits<double>::max();
+    for (int i = 1; i <= vertices.Extent(); i++) {
+        x = std::min(x, BRep_Tool::Pnt(TopoDS::Vertex(vertices(i))).X());
+    }
+    return x;
+}
+
+QByteArray readFile(const QString &path) {
+    QFile file{path};
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray{};
+}
+
+// Reads a little-endian integer of 2 or 4 bytes, or 0 past the end of the data
+uint32_t readLe(const QByteArray &data, qsizetype pos, int size) {
+    if (pos < 0 || pos + size > data.size()) {
+        return 0;
+    }
+
+    uint32_t v = 0;
+    for (int i = size - 1; i >= 0; i--) {
+        v = (v << 8) | static_cast<uint8_t>(data[pos + i]);
+    }
+    return v;
+}
+
+uint32_t zipCrc(const QByteArray &data) {
+    uint32_t crc = 0xffffffffu;
+    for (const char c : data) {
+        crc ^= static_cast<uint8_t>(c);
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// Reads the stored entries of a ZIP archive through its central directory and checks that the local headers, data
+// descriptors and checksums agree with it. Returns an error message, or an empty string on success.
+QString readZip(const QByteArray &zip, std::vector<std::pair<QString, QByteArray>> &entries) {
+    const qsizetype end = zip.size() - 22;
+    if (end < 0 || readLe(zip, end, 4) != 0x06054b50) {
+        return "no end of central directory";
+    }
+
+    const auto count = readLe(zip, end + 10, 2);
+    const qsizetype directorySize = readLe(zip, end + 12, 4);
+    qsizetype pos = readLe(zip, end + 16, 4);
+    if (pos + directorySize != end) {
+        return "central directory does not end at the end record";
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (pos + 46 > end || readLe(zip, pos, 4) != 0x02014b50) {
+            return QString("bad central directory entry %1").arg(i);
+        }
+
+        const auto crc = readLe(zip, pos + 16, 4);
+        const qsizetype size = readLe(zip, pos + 24, 4);
+        const auto nameLength = readLe(zip, pos + 28, 2);
+        const auto rawName = zip.mid(pos + 46, nameLength);
+        const auto name = QString::fromUtf8(rawName);
+        const qsizetype local = readLe(zip, pos + 42, 4);
+
+        if (readLe(zip, pos + 10, 2) != 0 || readLe(zip, pos + 20, 4) != size) {
+            return name + " is not stored";
+        }
+
+        if (readLe(zip, local, 4) != 0x04034b50 || readLe(zip, local + 26, 2) != nameLength
+            || zip.mid(local + 30, nameLength) != rawName) {
+            return name + " has no matching local header";
+        }
+
+        const qsizetype dataStart = local + 30 + nameLength + readLe(zip, local + 28, 2);
+        const auto data = zip.mid(dataStart, size);
+        if (zipCrc(data) != crc) {
+            return name + " has a wrong checksum";
+        }
+
+        const qsizetype descriptor = dataStart + size;
+        if (readLe(zip, descriptor, 4) != 0x08074b50 || readLe(zip, descriptor + 4, 4) != crc
+            || readLe(zip, descriptor + 8, 4) != size || readLe(zip, descriptor + 12, 4) != size) {
+            return name + " has no matching data descriptor";
+        }
+
+        entries.emplace_back(name, data);
+        pos += 46 + nameLength + readLe(zip, pos + 30, 2) + readLe(zip, pos + 32, 2);
+    }
+
+    return {};
+}
+
+struct MeshObject {
+    int vertices = 0;
+    std::vector<std::array<int, 3>> triangles;
+};
+
+std::vector<MeshObject> readModelObjects(const QByteArray &model) {
+    std::vector<MeshObject> objects;
+
+    QXmlStreamReader xml{model};
+    while (!xml.atEnd()) {
+        if (xml.readNext() != QXmlStreamReader::StartElement) {
+            continue;
+        }
+
+        const auto attr = [&](const char *name) { return xml.attributes().value(name).toInt(); };
+        if (xml.name() == u"object") {
+            objects.emplace_back();
+        } else if (xml.name() == u"vertex") {
+            objects.back().vertices++;
+        } else if (xml.name() == u"triangle") {
+            objects.back().triangles.push_back({attr("v1"), attr("v2"), attr("v3")});
+        }
+    }
+
+    return objects;
+}
+
+}
+
 class ExecutorTest : public QObject
 {
     Q_OBJECT
@@ -114,6 +359,513 @@ private slots:
         QTest::newRow("nested_ternary_true") << "0 ? 1 : 2 ? 3 : 4" << Value{3};
         QTest::newRow("nested_ternary_false") << "0 ? 1 : 0 ? 3 : 4" << Value{4};
     }
+
+    void testReadStl() {
+        QFETCH(QByteArray, data);
+        QFETCH(bool, valid);
+        QFETCH(TopAbs_ShapeEnum, type);
+        QFETCH(int, faces);
+        QFETCH(int, edges);
+        QFETCH(int, vertices);
+
+        const auto result = readStl(std::string_view{data.constData(), static_cast<size_t>(data.size())});
+
+        QCOMPARE(result.shape.has_value(), valid);
+        if (!valid) {
+            QVERIFY(!result.error.empty());
+            return;
+        }
+
+        QCOMPARE(result.shape->ShapeType(), type);
+        QCOMPARE(countSubShapes(*result.shape, TopAbs_FACE), faces);
+        // Triangles that share a side share its edge
+        QCOMPARE(countSubShapes(*result.shape, TopAbs_EDGE), edges);
+        QCOMPARE(countSubShapes(*result.shape, TopAbs_VERTEX), vertices);
+    }
+
+    void testReadStl_data() {
+        QTest::addColumn<QByteArray>("data");
+        QTest::addColumn<bool>("valid");
+        QTest::addColumn<TopAbs_ShapeEnum>("type");
+        QTest::addColumn<int>("faces");
+        QTest::addColumn<int>("edges");
+        QTest::addColumn<int>("vertices");
+
+        QTest::newRow("ascii_closed") << asciiStl(c_tetrahedron) << true << TopAbs_SOLID << 4 << 6 << 4;
+        QTest::newRow("binary_closed") << binaryStl(c_tetrahedron) << true << TopAbs_SOLID << 4 << 6 << 4;
+
+        QTest::newRow("ascii_open") //
+            << asciiStl({c_tetrahedron[0], c_tetrahedron[1]})
+            << true << TopAbs_SHELL << 2 << 5 << 4;
+
+        // Vertices closer than the welding tolerance become one
+        auto nudged = c_tetrahedron;
+        nudged[3][0] += 1e-7f;
+        QTest::newRow("binary_weld_within_tolerance") << binaryStl(nudged) << true << TopAbs_SOLID << 4 << 6 << 4;
+
+        // Triangles that collapse when welded are dropped
+        auto degenerate = c_tetrahedron;
+        degenerate.push_back({0, 0, 0, 0, 0, 1e-7f, 1, 1, 1});
+        QTest::newRow("binary_degenerate") << binaryStl(degenerate) << true << TopAbs_SOLID << 4 << 6 << 4;
+
+        QTest::newRow("empty_binary") << binaryStl({}) << false << TopAbs_SHAPE << 0 << 0 << 0;
+        QTest::newRow("garbage") << QByteArray("not an stl") << false << TopAbs_SHAPE << 0 << 0 << 0;
+
+        QTest::newRow("ascii_short_facet") //
+            << QByteArray("solid x\nfacet normal 0 0 0\nouter loop\nvertex 0 0 0\nvertex 1 0 0\nendloop\nendfacet\nendsolid x\n")
+            << false << TopAbs_SHAPE << 0 << 0 << 0;
+    }
+
+    void testShapeIo() {
+        QFETCH(Value, prop);
+        QFETCH(Value, expected);
+
+        const TopoDS_Shape box = BRepPrimAPI_MakeBox(1, 2, 3).Shape();
+        gp_Trsf move;
+        move.SetTranslation(gp_Vec{5, 0, 0});
+
+        const ShapeList shapes{
+            Shape{box, {{"value", prop}, {"name", "box"}}, {Span{1, 5, 0, 1}, Span{7, 9, 1, 2}}},
+            Shape{},
+            Shape{box.Moved(TopLoc_Location{move}), Span{10, 12, 2, 0}},
+        };
+
+        std::stringstream stream;
+        writeShapes(stream, shapes);
+        const auto read = readShapes(stream);
+
+        QVERIFY(read);
+        QCOMPARE(read->size(), shapes.size());
+
+        QCOMPARE((*read)[0].getProp("value"), expected);
+        QCOMPARE((*read)[0].getProp("name"), Value{"box"});
+        QVERIFY((*read)[0].spans() == shapes[0].spans());
+        QVERIFY((*read)[2].spans() == shapes[2].spans());
+
+        QVERIFY((*read)[1].shape().IsNull());
+
+        // Instances still share their TShape, each at its own location
+        QVERIFY((*read)[0].shape().IsPartner((*read)[2].shape()));
+        QVERIFY((*read)[2].shape().Location().Transformation().TranslationPart().IsEqual(gp_XYZ{5, 0, 0}, 1e-12));
+    }
+
+    void testShapeIo_data() {
+        QTest::addColumn<Value>("prop");
+        QTest::addColumn<Value>("expected");
+
+        QTest::newRow("number") << Value{1.5} << Value{1.5};
+        QTest::newRow("string") << Value{"red"} << Value{"red"};
+        QTest::newRow("bool") << Value{true} << Value{true};
+        QTest::newRow("list") << Value{ValueList{1.0, ValueList{"a", false}}} << Value{ValueList{1.0, ValueList{"a", false}}};
+        // Values that cannot be serialized are read back as undefined
+        QTest::newRow("function") << Value{Function{[](CallContext &) { return Value{}; }}} << Value{undefined};
+        QTest::newRow("shapes") << Value{ShapeList{}} << Value{undefined};
+    }
+
+    void testMessages() {
+        QFETCH(QString, code);
+        QFETCH(QStringList, expected);
+
+        Executor executor;
+        const auto result = executor.execute(code.toStdString());
+
+        QStringList actual;
+        for (const auto &msg : result.messages) {
+            actual << QString::fromStdString(msg.message);
+        }
+
+        QCOMPARE(actual, expected);
+    }
+
+    void testMessages_data() {
+        QTest::addColumn<QString>("code");
+        QTest::addColumn<QStringList>("expected");
+
+        QTest::newRow("single") << "x;" << QStringList{"name 'x' not found"};
+        QTest::newRow("distinct_spans") << "x; x;" << QStringList{"name 'x' not found", "name 'x' not found"};
+
+        QTest::newRow("merged_same_span") //
+            << "def f() { x } f(); f(); f();"
+            << QStringList{"name 'x' not found (3 times)"};
+
+        // One call with two invalid arguments reports both, each once
+        QTest::newRow("distinct_arguments") //
+            << "cyl(r1=\"a\", r2=\"b\");"
+            << QStringList{"invalid argument r1: type is string, expected number",
+                           "invalid argument r2: type is string, expected number"};
+
+        // Output is kept line by line
+        QTest::newRow("info_not_merged") //
+            << "def f() { echo(\"hi\") } f(); f();"
+            << QStringList{"hi", "hi"};
+    }
+
+    void testPartialResults() {
+        QFETCH(QString, code);
+        QFETCH(QList<int>, partialSizes);
+        QFETCH(int, statements);
+
+        QList<int> actualSizes;
+        QList<int> finished;
+        ExecutorCallbacks callbacks{
+            [&](const ShapeList &shapes) { actualSizes << static_cast<int>(shapes.size()); },
+            [&](size_t done, size_t total) {
+                QCOMPARE(static_cast<int>(total), statements);
+                finished << static_cast<int>(done);
+            },
+        };
+
+        Executor executor;
+        const auto result = executor.execute(code.toStdString(), callbacks);
+
+        QVERIFY(result.result && result.result->is<ShapeList>());
+        QCOMPARE(actualSizes, partialSizes);
+
+        QList<int> expectedFinished;
+        for (int i = 1; i <= statements; i++) {
+            expectedFinished << i;
+        }
+        QCOMPARE(finished, expectedFinished);
+    }
+
+    void testPartialResults_data() {
+        QTest::addColumn<QString>("code");
+        QTest::addColumn<QList<int>>("partialSizes");
+        QTest::addColumn<int>("statements");
+
+        // The final statement's shapes arrive as the result, not as a partial result
+        QTest::newRow("single") << "box(1);" << QList<int>{} << 1;
+        QTest::newRow("sequence") << "box(1); box(2); box(3);" << QList<int>{1, 2} << 3;
+
+        // Statements inside functions do not report, and statements without shapes do not cause a partial result
+        QTest::newRow("nested") //
+            << "def f() { box(1); box(2); } f(); echo(\"hi\"); f();"
+            << QList<int>{2} << 4;
+    }
+
+    void testStartedRuns() {
+        QFETCH(int, runs);
+        QFETCH(bool, cancelAll);
+
+        // Takes far longer than the test unless canceled
+        const std::string slow = "def f(n) { n > 0 ? f(n - 1) + f(n - 1) : 1 } f(40);";
+
+        Executor executor;
+        std::vector<std::shared_ptr<ExecutorRun>> slowRuns;
+        for (int i = 0; i < runs; i++) {
+            slowRuns.push_back(executor.start(slow));
+        }
+
+        const auto quick = executor.start("box(1);");
+        QVERIFY(executor.isBusy());
+
+        if (cancelAll) {
+            executor.cancel();
+        } else {
+            for (const auto &run : slowRuns) {
+                run->cancel();
+            }
+        }
+
+        for (const auto &run : slowRuns) {
+            QVERIFY(run->result().canceled);
+            QVERIFY(!run->result().result);
+            QVERIFY(run->isFinished());
+        }
+
+        // Canceling one run leaves the others alone, while canceling the executor also cancels queued runs
+        const auto &result = quick->result();
+        QCOMPARE(result.canceled, cancelAll);
+        if (!cancelAll) {
+            QVERIFY(result.result && result.result->is<ShapeList>());
+            QCOMPARE(result.result->as<ShapeList>().size(), size_t{1});
+        }
+
+        QVERIFY(quick->isFinished());
+        QVERIFY(!executor.isBusy());
+    }
+
+    void testStartedRuns_data() {
+        QTest::addColumn<int>("runs");
+        QTest::addColumn<bool>("cancelAll");
+
+        QTest::newRow("one_run") << 1 << false;
+        QTest::newRow("queued_runs") << 8 << false;
+        // Enough slow runs to keep every thread busy, so the quick run is still queued when the executor is canceled
+        QTest::newRow("queued_runs_executor") << 8 << true;
+    }
+
+    void testDestroyingExecutorCancelsRuns() {
+        std::shared_ptr<ExecutorRun> running;
+        std::shared_ptr<ExecutorRun> queued;
+
+        {
+            Executor executor;
+            running = executor.start("def f(n) { n > 0 ? f(n - 1) + f(n - 1) : 1 } f(40);");
+            for (int i = 0; i < 8; i++) {
+                executor.start("def f(n) { n > 0 ? f(n - 1) + f(n - 1) : 1 } f(40);");
+            }
+            queued = executor.start("box(1);");
+        }
+
+        QVERIFY(running->isFinished());
+        QVERIFY(running->result().canceled);
+        QVERIFY(queued->isFinished());
+        QVERIFY(queued->result().canceled);
+    }
+
+    void testMessageLimit() {
+        ExecutionContext context{std::make_shared<std::atomic_bool>()};
+
+        for (int i = 0; i < static_cast<int>(c_maxMessages) + 5; i++) {
+            context.addMessage(LogMessage::Level::Warning, Span{i, i + 1, 0, i}, "warning {}", i);
+        }
+
+        // Repeats of a kept message are still counted once the limit is reached
+        context.addMessage(LogMessage::Level::Warning, Span{0, 1, 0, 0}, "warning {}", 0);
+
+        const auto messages = context.messages();
+        QCOMPARE(messages.size(), c_maxMessages + 1);
+        QCOMPARE(messages.front().message, std::string{"warning 0 (2 times)"});
+        QCOMPARE(messages[c_maxMessages - 1].message, std::format("warning {}", c_maxMessages - 1));
+        QCOMPARE(messages.back().message, std::string{"5 more messages not shown"});
+    }
+
+    void testMessageArgumentLifetime() {
+        ExecutionContext context{std::make_shared<std::atomic_bool>()};
+
+        {
+            std::string text = "gone by the time messages are formatted";
+            const std::string_view view = text;
+            context.addMessage(LogMessage::Level::Error, Span{0, 1, 0, 0}, "{} / {}", text.c_str(), view);
+            text.assign(text.size(), 'x');
+        }
+
+        const auto messages = context.messages();
+        QCOMPARE(messages.size(), size_t{1});
+        QCOMPARE(messages.front().message,
+                 std::string{"gone by the time messages are formatted / gone by the time messages are formatted"});
+    }
+
+    void testFidelity() {
+        QFETCH(QString, code);
+        QFETCH(Fidelity, fidelity);
+        QFETCH(QList<int>, faces);
+        QFETCH(QList<bool>, preview);
+        QFETCH(QList<bool>, highlight);
+        QFETCH(bool, simplified);
+
+        Executor executor;
+        const auto result = executor.execute(code.toStdString(), {}, fidelity);
+
+        QVERIFY(result.result && result.result->is<ShapeList>());
+        QCOMPARE(result.simplified, simplified);
+
+        const auto shapes = result.result->as<ShapeList>();
+        QCOMPARE(static_cast<int>(shapes.size()), faces.size());
+
+        for (size_t i = 0; i < shapes.size(); i++) {
+            QCOMPARE(countSubShapes(shapes[i].shape(), TopAbs_FACE), faces[i]);
+            QCOMPARE(shapes[i].hasProp("preview"), preview[i]);
+            QCOMPARE(shapes[i].hasProp("highlight"), highlight[i]);
+        }
+    }
+
+    void testFidelity_data() {
+        QTest::addColumn<QString>("code");
+        QTest::addColumn<Fidelity>("fidelity");
+        QTest::addColumn<QList<int>>("faces");
+        QTest::addColumn<QList<bool>>("preview");
+        QTest::addColumn<QList<bool>>("highlight");
+        QTest::addColumn<bool>("simplified");
+
+        const QString combine = "combine() { box(2); remove() box(1); }";
+        const QString fillet = "fillet(\"z\") box(4);";
+        const QString chamfer = "chamfer(\"z\") box(4);";
+
+        // Cutting a corner out of a box leaves three new faces
+        QTest::newRow("combine_full") << combine << Fidelity::Full << QList<int>{9} << QList<bool>{false}
+                                      << QList<bool>{false} << false;
+        QTest::newRow("fillet_full") << fillet << Fidelity::Full << QList<int>{10} << QList<bool>{false}
+                                     << QList<bool>{false} << false;
+        QTest::newRow("chamfer_full") << chamfer << Fidelity::Full << QList<int>{10} << QList<bool>{false}
+                                      << QList<bool>{false} << false;
+
+        // Proxies are a box around what is kept, and chamfers and fillets return their children unchanged
+        QTest::newRow("combine_proxy") << combine << Fidelity::Proxy << QList<int>{6} << QList<bool>{false}
+                                       << QList<bool>{false} << true;
+        QTest::newRow("fillet_proxy") << fillet << Fidelity::Proxy << QList<int>{6} << QList<bool>{false}
+                                      << QList<bool>{false} << true;
+        QTest::newRow("chamfer_proxy") << chamfer << Fidelity::Proxy << QList<int>{6} << QList<bool>{false}
+                                       << QList<bool>{false} << true;
+
+        // Previews overlay the operands, with what would be cut away highlighted, and show edges sharp
+        QTest::newRow("combine_preview") << combine << Fidelity::Preview << QList<int>{6, 6} << QList<bool>{true, true}
+                                         << QList<bool>{false, true} << true;
+        QTest::newRow("fillet_preview") << fillet << Fidelity::Preview << QList<int>{6} << QList<bool>{true}
+                                        << QList<bool>{false} << true;
+        QTest::newRow("chamfer_preview") << chamfer << Fidelity::Preview << QList<int>{6} << QList<bool>{true}
+                                         << QList<bool>{false} << true;
+    }
+
+    void testMeshCacheMatchesEdges() {
+        QFETCH(QString, first);
+        QFETCH(QString, second);
+        QFETCH(bool, restored);
+
+        const auto a = testFace(first);
+        const auto b = testFace(second);
+        meshWithCache(a, 0.01, 0.5);
+        meshWithCache(b, 0.01, 0.5);
+
+        TopLoc_Location location;
+        const auto triangulationA = BRep_Tool::Triangulation(a, location);
+        const auto triangulationB = BRep_Tool::Triangulation(b, location);
+        QVERIFY(!triangulationA.IsNull() && !triangulationB.IsNull());
+
+        // A restored mesh is the cached triangulation itself
+        QCOMPARE(triangulationA == triangulationB, restored);
+    }
+
+    void testMeshCacheMatchesEdges_data() {
+        QTest::addColumn<QString>("first");
+        QTest::addColumn<QString>("second");
+        QTest::addColumn<bool>("restored");
+
+        QTest::newRow("same_square") << "square" << "square" << true;
+        QTest::newRow("bent_edge") << "square" << "bent" << false;
+        QTest::newRow("same_hole") << "hole" << "hole" << true;
+        QTest::newRow("moved_hole") << "hole" << "moved_hole" << false;
+    }
+
+    void testShapeIoRejectsInvalidData() {
+        std::stringstream empty;
+        QVERIFY(!readShapes(empty));
+
+        std::stringstream stream;
+        writeShapes(stream, ShapeList{Shape{BRepPrimAPI_MakeBox(1, 1, 1).Shape()}});
+        auto data = stream.str();
+        data.resize(data.size() / 2);
+
+        std::stringstream truncated{data};
+        QVERIFY(!readShapes(truncated));
+    }
+
+    void testExportStl() {
+        QFETCH(double, offset);
+
+        QTemporaryDir dir;
+        const auto path = dir.filePath("box.stl");
+        const auto exported = exportShapes(path.toStdString(), movedBoxes({offset}));
+        QVERIFY2(exported.ok, exported.error.c_str());
+
+        // Two triangles per side of the box
+        const auto data = readFile(path);
+        QCOMPARE(readLe(data, 80, 4), 12u);
+        QCOMPARE(data.size(), qsizetype{84 + 12 * 50});
+
+        const auto result = readStl(std::string_view{data.constData(), static_cast<size_t>(data.size())});
+        QVERIFY(result.shape);
+
+        // The triangles of adjacent sides meet at the same vertices, so they weld into a closed solid
+        QCOMPARE(result.shape->ShapeType(), TopAbs_SOLID);
+        QCOMPARE(countSubShapes(*result.shape, TopAbs_FACE), 12);
+        QCOMPARE(countSubShapes(*result.shape, TopAbs_EDGE), 18);
+        QCOMPARE(countSubShapes(*result.shape, TopAbs_VERTEX), 8);
+
+        QVERIFY(std::abs(minX(*result.shape) - offset) < 1e-6);
+    }
+
+    void testExportStl_data() {
+        QTest::addColumn<double>("offset");
+
+        QTest::newRow("box") << 0.0;
+        QTest::newRow("moved_box") << 5.0;
+    }
+
+    void testExport3mf() {
+        QFETCH(QList<double>, offsets);
+
+        QTemporaryDir dir;
+        const auto path = dir.filePath("boxes.3mf");
+        const auto exported = exportShapes(path.toStdString(), movedBoxes(offsets));
+        QVERIFY2(exported.ok, exported.error.c_str());
+
+        std::vector<std::pair<QString, QByteArray>> entries;
+        QCOMPARE(readZip(readFile(path), entries), QString{});
+
+        QStringList names;
+        for (const auto &entry : entries) {
+            names << entry.first;
+        }
+        QCOMPARE(names, (QStringList{"[Content_Types].xml", "_rels/.rels", "3D/3dmodel.model"}));
+
+        const auto objects = readModelObjects(entries.back().second);
+        QCOMPARE(objects.size(), static_cast<size_t>(offsets.size()));
+
+        for (const auto &object : objects) {
+            // Welded per object, also where boxes touch
+            QCOMPARE(object.vertices, 8);
+            QCOMPARE(object.triangles.size(), size_t{12});
+
+            // Closed and consistently wound: every side runs once in each direction
+            std::map<std::pair<int, int>, int> sides;
+            for (const auto &t : object.triangles) {
+                for (int i = 0; i < 3; i++) {
+                    QVERIFY(t[i] >= 0 && t[i] < object.vertices);
+                    sides[{t[i], t[(i + 1) % 3]}]++;
+                }
+            }
+
+            for (const auto &[side, count] : sides) {
+                QCOMPARE(count, 1);
+                QVERIFY(sides.count({side.second, side.first}));
+            }
+        }
+    }
+
+    void testExport3mf_data() {
+        QTest::addColumn<QList<double>>("offsets");
+
+        QTest::newRow("box") << QList<double>{0.0};
+        QTest::newRow("touching_boxes") << QList<double>{0.0, 1.0};
+        QTest::newRow("apart_boxes") << QList<double>{0.0, 3.0};
+    }
+
+    void testExportStepInstances() {
+        auto shapes = movedBoxes({0.0, 3.0, 6.0});
+
+        // Mirroring cannot be a location, so the mirrored copy has its own TShape
+        gp_Trsf mirror;
+        mirror.SetMirror(gp_Ax2{gp::Origin(), gp::DX()});
+        shapes.push_back(Shape{BRepBuilderAPI_Transform(shapes.front().shape(), mirror, true).Shape()});
+
+        QTemporaryDir dir;
+        const auto path = dir.filePath("boxes.step");
+        const auto exported = exportShapes(path.toStdString(), shapes);
+        QVERIFY2(exported.ok, exported.error.c_str());
+
+        const auto result = readStep(path.toStdString());
+        QVERIFY2(result.shapes, result.error.c_str());
+        QCOMPARE(result.shapes->size(), size_t{4});
+
+        std::vector<TopoDS_Shape> parts;
+        for (const auto &part : *result.shapes) {
+            parts.push_back(part.shape());
+        }
+        std::sort(parts.begin(), parts.end(), [](const auto &a, const auto &b) { return minX(a) < minX(b); });
+
+        // Every part is back in its place, the mirrored one on the other side of the YZ plane
+        const std::array<double, 4> expected{-1.0, 0.0, 3.0, 6.0};
+        for (size_t i = 0; i < parts.size(); i++) {
+            QVERIFY(std::abs(minX(parts[i]) - expected[i]) < 1e-6);
+        }
+
+        // The moved copies are placements of one written part, the mirrored copy is a part of its own
+        QVERIFY(parts[1].IsPartner(parts[2]));
+        QVERIFY(parts[1].IsPartner(parts[3]));
+        QVERIFY(!parts[0].IsPartner(parts[1]));
+    }
 };
 
 QTEST_APPLESS_MAIN(ExecutorTest)